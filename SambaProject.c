@@ -35,7 +35,7 @@ int main(int argc, char **argv) {
         fprintf(fp, "///////////////////////////////\n");
 
         fprintf(fp, "\n// Automatic sets verbose_mode to true: #define S_VERBOSE_MODE\n");
-        fprintf(fp, "// uses ccache with compiler: #define S_CACHE_COMPILATION\n");
+        fprintf(fp, "// caches compiled objects: #define S_CACHE_COMPILATION\n");
         fprintf(fp, "#define S_DEBUG_MODE\n");
         fprintf(fp, "// if you wanna make a optimized executable: #define S_RELEASE_MODE\n");
         fprintf(fp, "// if you wanna us clang: #define S_CMP_CLANG\n");
@@ -17,6 +17,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <stdarg.h>
@@ -28,13 +29,28 @@
 #include <limits.h>
 #include <dlfcn.h>
 #include <curl/curl.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <semaphore.h>
+#ifdef __linux__
+    #include <sys/syscall.h>
+    #include <linux/fs.h>
+#endif
 
 
 // INFO | Macros | Each starts with S_
 // | S_VERSION | Version of Samba                       | Samba Version
 // | S_AUTO | Automatic Setting of some Modes/Variables | Disabled
 // | S_COMPILER | Compiler Selection                    | GCC
-// | S_CACHE_COMPILATION | Sets S_COMPILER as ccache    | Disabled
+// | S_CACHE_COMPILATION | Enables the object cache     | Disabled
+// | S_CACHE_SIZE_MB | Object cache size limit            | 2048
 // | S_VERBOSE_MODE | Setting verbose_mode to true      | Disabled
 // | S_OS | Returns Compilation Target OS               | Disabled
 // | S_CMP_CLANG | Used to set S_COMPILER               | Disabled
@@ -45,6 +61,21 @@
 // | S_REBUILD_NO_OUTPUT | Displays no out on rebuild   | -1
 // | S_CURLE | Enables using curl withing an easier interface | Disabled
 // | S_CURLE_SET | 1 IF S_CURLE ENABLED                 | 0
+// | S_CONTENT_HASH | Rebuild only if file contents changed | Disabled
+// | S_JOBS | Max parallel jobs                           | Online CPUs
+// | S_UNITY_BUILD | compile_target builds unity batches  | Disabled
+// | S_UNITY_BATCH_SIZE | Sources per unity batch         | 0 (automatic)
+// | S_COMPILE_COMMANDS | Writes build/compile_commands.json | Disabled
+// | S_ESTIMATE_BYTES_PER_SECOND | Scheduling guess for new sources | 20000
+// | S_AT_LEAST | Builtin arity, n or more arguments     | -
+// | S_UNUSED | Marks builtin parameters a handler ignores | -
+// | S_RESPONSE_FILE_BYTES | Longer compiler commands use @file | 65536
+// | S_AR | Archiver for compile_static_library         | ar
+// | S_THIN_ARCHIVE | Static libraries are thin archives  | Disabled
+// | S_LTO_MODE | Link time optimization (ThinLTO on clang) | Disabled
+// | S_LTO_AR | Archiver used with S_LTO_MODE            | gcc-ar / llvm-ar
+// | S_LTO_CACHE_POLICY | Pruning of the ThinLTO cache     | prune_after=168h:cache_size_bytes=2g
+// | S_PGO_STALE_FRACTION | Share of changed sources that retrains PGO | 0.25
 
 // -- Macros --
 #define S_VERSION "1.1"
@@ -81,19 +112,13 @@
 #endif
 
 #ifdef S_CMP_CLANG
-    #ifndef S_CACHE_COMPILATION
-        #define S_COMPILER "clang"
-    #else
-        #define S_COMPILER "ccache clang"
-    #endif
+    #define S_COMPILER "clang"
 #else
-    #ifndef S_CACHE_COMPILATION
-        #define S_COMPILER "gcc"
-    #else
-        #define S_COMPILER "ccache gcc"
-    #endif
+    #define S_COMPILER "gcc"
 #endif
 
+extern char **environ;
+
 char *build_directory = "build";
 char *checkpoints_directory = "checkpoints/";
 
@@ -116,6 +141,356 @@ size_t num_includes = 0;
 size_t num_library_paths = 0;
 size_t num_variables = 0;
 size_t num_flags = 0;
+size_t libraries_capacity = 0;
+size_t includes_capacity = 0;
+size_t library_paths_capacity = 0;
+size_t variables_capacity = 0;
+size_t flags_capacity = 0;
+
+/*
+  @name hash_bytes
+  @parameters uint64_t hash, void *data, size_t length
+  @description FNV-1a 64 bit hash, pass 14695981039346656037 as starting hash
+  @returns uint64_t
+*/
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+#define S_HASH_SEED 14695981039346656037ULL
+
+/*
+  @name hash_bytes_mix
+  @parameters uint64_t hash, void *data, size_t length
+  @description Second 64 bit hash that does not share collisions with hash_bytes, pass S_HASH_MIX_SEED | keys that must not collide use both
+  @returns uint64_t
+*/
+uint64_t hash_bytes_mix(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+#define S_HASH_MIX_SEED 0x9e3779b97f4a7c15ULL
+
+// -- Arena --
+// INFO: Bump allocator, memory is released per arena instead of per allocation
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head; // newest block, allocations never move
+} Arena;
+
+/*
+  @name arena_alloc
+  @parameters Arena *arena, size_t size
+  @description Allocates from an arena, everything is released at once by arena_reset or arena_free | blocks double in size
+  @returns void *
+*/
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    ArenaBlock *block = arena->head;
+    if (!block || block->size - block->used < size) {
+        size_t block_size = block ? block->size * 2 : 4096;
+        while (block_size < size) block_size *= 2;
+        ArenaBlock *grown = malloc(sizeof(ArenaBlock) + block_size);
+        if (!grown) return NULL;
+        grown->next = block;
+        grown->used = 0;
+        grown->size = block_size;
+        arena->head = block = grown;
+    }
+    void *memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+/*
+  @name arena_strndup
+  @parameters Arena *arena, char *string, size_t length
+  @description Copies length bytes of string into the arena and terminates them
+  @returns char *
+*/
+char *arena_strndup(Arena *arena, const char *string, size_t length) {
+    char *copy = arena_alloc(arena, length + 1);
+    if (!copy) return NULL;
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/*
+  @name arena_free
+  @parameters Arena *arena
+  @description Frees every allocation of an arena
+  @returns void
+*/
+void arena_free(Arena *arena) {
+    while (arena->head) {
+        ArenaBlock *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
+    }
+}
+
+/*
+  @name arena_reset
+  @parameters Arena *arena
+  @description Releases every allocation but keeps the newest (largest) block for reuse
+  @returns void
+*/
+void arena_reset(Arena *arena) {
+    if (!arena->head) return;
+    ArenaBlock *older = arena->head->next;
+    while (older) {
+        ArenaBlock *next = older->next;
+        free(older);
+        older = next;
+    }
+    arena->head->next = NULL;
+    arena->head->used = 0;
+}
+
+// -- Settings Store --
+// INFO: Strings live in settings_arena, every list has an insertion ordered hash index so adding the same entry twice is folded
+// INFO: Removing an entry leaves a tombstone (key == NULL) that emitters skip, lists are compacted once half of them are tombstones
+Arena settings_arena = {0};
+
+/*
+  @name settings_string
+  @parameters char *string
+  @description PRIVATE FUNCTION | Copies a setting into settings_arena
+  @returns char *
+*/
+static char *settings_string(const char *string) {
+    return arena_strndup(&settings_arena, string, strlen(string));
+}
+
+/*
+  @name settings_reserve
+  @parameters void **array, size_t count, size_t *capacity, size_t item_size
+  @description PRIVATE FUNCTION | Makes room for one more item, the capacity doubles so appends are amortized O(1)
+  @returns int
+*/
+static int settings_reserve(void **array, size_t count, size_t *capacity, size_t item_size) {
+    if (count < *capacity) return 0;
+    size_t new_capacity = *capacity ? *capacity * 2 : 16;
+    void *temp = realloc(*array, new_capacity * item_size);
+    if (!temp) return S_ERROR;
+    *array = temp;
+    *capacity = new_capacity;
+    return 0;
+}
+
+typedef struct {
+    uint64_t *slots; // generation << 32 | position + 1, slots of an older generation count as empty, position + 1 == 0 is a removed key
+    size_t capacity;
+    size_t count;
+    size_t removed;  // tombstones in the list
+    uint32_t generation;
+} SettingsIndex;
+
+uint32_t settings_generation = 1; // reset_settings empties every index at once by bumping it
+SettingsIndex libraries_index = {0};
+SettingsIndex includes_index = {0};
+SettingsIndex library_paths_index = {0};
+SettingsIndex variables_index = {0};
+SettingsIndex flags_index = {0};
+
+/*
+  @name settings_key
+  @parameters void *array, size_t stride, size_t position
+  @description PRIVATE FUNCTION | Key of an item, Entry and char * both start with it
+  @returns char *
+*/
+static const char *settings_key(const void *array, size_t stride, size_t position) {
+    return *(char *const *)((const char *)array + position * stride);
+}
+
+/*
+  @name settings_index_slot
+  @parameters SettingsIndex *index, void *array, size_t stride, char *key, bool *found
+  @description PRIVATE FUNCTION | Slot of key, or of the empty slot where it would go
+  @returns size_t
+*/
+static size_t settings_index_slot(SettingsIndex *index, const void *array, size_t stride, const char *key, bool *found) {
+    if (index->generation != settings_generation) {
+        index->generation = settings_generation;
+        index->count = index->removed = 0;
+    }
+    size_t mask = index->capacity - 1;
+    size_t slot = (size_t)hash_bytes(S_HASH_SEED, key, strlen(key)) & mask;
+    while ((index->slots[slot] >> 32) == index->generation) {
+        size_t position = (uint32_t)index->slots[slot] - 1;
+        if ((uint32_t)index->slots[slot] != 0 && strcmp(settings_key(array, stride, position), key) == 0) {
+            *found = true;
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    *found = false;
+    return slot;
+}
+
+/*
+  @name settings_index_find
+  @parameters SettingsIndex *index, void *array, size_t stride, char *key, size_t *position
+  @description PRIVATE FUNCTION | Position of key in the list, O(1)
+  @returns bool
+*/
+static bool settings_index_find(SettingsIndex *index, const void *array, size_t stride, const char *key, size_t *position) {
+    if (index->capacity == 0) return false;
+    bool found;
+    size_t slot = settings_index_slot(index, array, stride, key, &found);
+    if (found && position) *position = (uint32_t)index->slots[slot] - 1;
+    return found;
+}
+
+/*
+  @name settings_index_add
+  @parameters SettingsIndex *index, void *array, size_t stride, size_t position
+  @description PRIVATE FUNCTION | Indexes the item at position, an already indexed key keeps its first position
+  @returns int
+*/
+static int settings_index_add(SettingsIndex *index, const void *array, size_t stride, size_t position) {
+    if (index->generation != settings_generation) {
+        index->generation = settings_generation;
+        index->count = index->removed = 0;
+    }
+    if ((index->count + 1) * 2 > index->capacity) {
+        size_t new_capacity = index->capacity ? index->capacity * 2 : 64;
+        uint64_t *slots = calloc(new_capacity, sizeof(uint64_t));
+        if (!slots) return S_ERROR;
+        uint64_t *old_slots = index->slots;
+        size_t old_capacity = index->capacity;
+        index->slots = slots;
+        index->capacity = new_capacity;
+        index->count = 0;
+        for (size_t i = 0; i < old_capacity; i++) {
+            if ((old_slots[i] >> 32) != index->generation || (uint32_t)old_slots[i] == 0) continue;
+            bool found;
+            size_t slot = settings_index_slot(index, array, stride, settings_key(array, stride, (uint32_t)old_slots[i] - 1), &found);
+            index->slots[slot] = old_slots[i];
+            index->count++;
+        }
+        free(old_slots);
+    }
+
+    bool found;
+    size_t slot = settings_index_slot(index, array, stride, settings_key(array, stride, position), &found);
+    if (found) return 0;
+    index->slots[slot] = ((uint64_t)index->generation << 32) | (uint64_t)(position + 1);
+    index->count++;
+    return 0;
+}
+
+/*
+  @name settings_index_rebuild
+  @parameters SettingsIndex *index, void *array, size_t stride, size_t count, bool (*indexed)(size_t)
+  @description PRIVATE FUNCTION | Reindexes a list after items moved, indexed may skip positions
+  @returns int
+*/
+static int settings_index_rebuild(SettingsIndex *index, const void *array, size_t stride, size_t count, bool (*indexed)(size_t)) {
+    if (index->slots) memset(index->slots, 0, index->capacity * sizeof(uint64_t));
+    index->generation = settings_generation;
+    index->count = index->removed = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!settings_key(array, stride, i) || (indexed && !indexed(i))) continue;
+        if (settings_index_add(index, array, stride, i) != 0) return S_ERROR;
+    }
+    return 0;
+}
+
+/*
+  @name settings_remove_at
+  @parameters SettingsIndex *index, void *array, size_t stride, size_t *count, size_t position, bool (*indexed)(size_t)
+  @description PRIVATE FUNCTION | Replaces one item with a tombstone in O(1), the order of the others is kept (link order matters) | compacts the list once half of it is tombstones, so removals stay amortized O(1)
+  @returns int
+*/
+static int settings_remove_at(SettingsIndex *index, void *array, size_t stride, size_t *count, size_t position, bool (*indexed)(size_t)) {
+    const char *key = settings_key(array, stride, position);
+    bool found = false;
+    size_t slot = index->capacity ? settings_index_slot(index, array, stride, key, &found) : 0;
+    if (found && (uint32_t)index->slots[slot] - 1 == position) index->slots[slot] = (uint64_t)index->generation << 32;
+    *(char **)((char *)array + position * stride) = NULL;
+    index->removed++;
+    if (index->removed < 16 || index->removed * 2 < *count) return 0;
+
+    char *base = array;
+    size_t kept = 0;
+    for (size_t i = 0; i < *count; i++) {
+        if (!settings_key(array, stride, i)) continue;
+        if (kept != i) memcpy(base + kept * stride, base + i * stride, stride);
+        kept++;
+    }
+    *count = kept;
+    return settings_index_rebuild(index, array, stride, kept, indexed);
+}
+
+/*
+  @name settings_index_free
+  @parameters SettingsIndex *index
+  @description PRIVATE FUNCTION | Frees an index
+  @returns void
+*/
+static void settings_index_free(SettingsIndex *index) {
+    free(index->slots);
+    memset(index, 0, sizeof(*index));
+}
+
+/*
+  @name flag_takes_argument
+  @parameters char *flag
+  @description PRIVATE FUNCTION | Flags whose value is the next flag, e.g. add_flag("-Xlinker"); add_flag("--as-needed");
+  @returns bool
+*/
+static bool flag_takes_argument(const char *flag) {
+    if (!flag) return false;
+    static const char *with_argument[] = {
+        "-Xlinker", "-Xassembler", "-Xpreprocessor", "-include", "-imacros", "-isystem", "-idirafter", "-iquote",
+        "-iprefix", "-isysroot", "--sysroot", "-framework", "-arch", "-target", "-x", "-MF", "-MT", "-MQ", "-o",
+        "-u", "-T", "-z", "-I", "-L", "-l", "-D", "-U"
+    };
+    for (size_t i = 0; i < sizeof(with_argument) / sizeof(with_argument[0]); i++) {
+        if (strcmp(flag, with_argument[i]) == 0) return true;
+    }
+    return false;
+}
+
+/*
+  @name flag_before
+  @parameters size_t position
+  @description PRIVATE FUNCTION | Returns the flag in front of position, skipping removed ones, or NULL
+  @returns const char *
+*/
+static const char *flag_before(size_t position) {
+    while (position > 0 && !flags[position - 1]) position--;
+    return position > 0 ? flags[position - 1] : NULL;
+}
+
+/*
+  @name flag_indexed
+  @parameters size_t position
+  @description PRIVATE FUNCTION | Only self contained flags are indexed, a flag and its argument are always kept as given
+  @returns bool
+*/
+static bool flag_indexed(size_t position) {
+    return !flag_takes_argument(flags[position]) && !flag_takes_argument(flag_before(position));
+}
 
 // -- Verbose Mode --
 // INFO: Can be set manually
@@ -177,899 +552,5264 @@ char *escape_argument(const char *arg) {
     return escaped;
 }
 
+// -- Processes --
+// INFO: Every tool samba starts goes through run_process (posix_spawn, no shell, no length limit)
+
+typedef struct {
+    char **items;
+    size_t count;
+    size_t capacity;
+} Command;
+
+typedef struct {
+    int exit_status;        // exit code, 128 + signal if killed, S_ERROR if it could not be started
+    double wall_seconds;
+    struct rusage usage;    // ru_maxrss is the peak RSS of the child in KiB
+} ProcessResult;
+
 /*
-  @name define_variable
-  @parameters char *var_name, char *var_value
-  @description Adds an Variable to Built Binary
-  @returns int
+  @name command_push
+  @parameters Command *command, char *arg
+  @description Appends one argument to an argv vector
+  @returns void
 */
-int define_variable(const char *var_name, const char *var_value) {
-    variables = realloc(variables, sizeof(Entry) * (num_variables + 1));
-    if (!variables) return S_ERROR;
-    variables[num_variables].key = strdup(var_name);
-    if (!variables[num_variables].key) return S_ERROR;
-    variables[num_variables].value = strdup(var_value);
-    if (!variables[num_variables].value) return S_ERROR;
-    num_variables++;
-    return 0;
+void command_push(Command *command, const char *arg) {
+    if (command->count + 2 > command->capacity) {
+        size_t new_capacity = command->capacity ? command->capacity * 2 : 16;
+        char **temp = realloc(command->items, sizeof(char *) * new_capacity);
+        if (!temp) exit_error(__func__, "Memory allocation failed");
+        command->items = temp;
+        command->capacity = new_capacity;
+    }
+    command->items[command->count] = strdup(arg);
+    if (!command->items[command->count]) exit_error(__func__, "Memory allocation failed");
+    command->items[++command->count] = NULL;
 }
 
 /*
-  @name define_library
-  @parameters char *library
-  @description Adds an Library to the build configuration
-  @returns int
+  @name command_pushf
+  @parameters Command *command, char *fmt, ...
+  @description Appends one formatted argument to an argv vector
+  @returns void
 */
-int define_library(const char *library) {
-    libraries = realloc(libraries, sizeof(Entry) * (num_libraries + 1));
-    if (!libraries) return S_ERROR;
-    libraries[num_libraries].key = strdup(library);
-    if (!libraries[num_libraries].key) return S_ERROR;
-    libraries[num_libraries].value = NULL;
-    num_libraries++;
-    return 0;
+void command_pushf(Command *command, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int length = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    char *arg = length < 0 ? NULL : malloc((size_t)length + 1);
+    if (!arg) exit_error(__func__, "Memory allocation failed");
+
+    va_start(args, fmt);
+    vsnprintf(arg, (size_t)length + 1, fmt, args);
+    va_end(args);
+    command_push(command, arg);
+    free(arg);
 }
 
 /*
-  @name define_include
-  @parameters char *include_path
-  @description Adds an Include to the build configuration
-  @returns int
+  @name command_push_split
+  @parameters Command *command, char *text
+  @description Appends every word of text (e.g. "ccache gcc" or "-Wall -DNAME=\"a b\""), honouring quotes and backslashes like the shell and pkg-config
+  @returns void
 */
-int define_include(const char *include_path) {
-    includes = realloc(includes, sizeof(Entry) * (num_includes + 1));
-    if (!includes) return S_ERROR;
-    includes[num_includes].key = strdup(include_path);
-    if (!includes[num_includes].key) return S_ERROR;
-    includes[num_includes].value = NULL;
-    num_includes++;
-    return 0;
+void command_push_split(Command *command, const char *text) {
+    if (!text) return;
+    char *word = malloc(strlen(text) + 1);
+    if (!word) exit_error(__func__, "Memory allocation failed");
+    const char *c = text;
+    while (*c) {
+        while (isspace((unsigned char)*c)) c++;
+        if (!*c) break;
+        size_t n = 0;
+        char quote = 0;
+        for (; *c && (quote || !isspace((unsigned char)*c)); c++) {
+            if (quote && *c == quote) quote = 0;
+            else if (!quote && (*c == '"' || *c == '\'')) quote = *c;
+            else if (*c == '\\' && c[1] && quote != '\'') word[n++] = *++c;
+            else word[n++] = *c;
+        }
+        word[n] = '\0';
+        command_push(command, word);
+    }
+    free(word);
 }
 
 /*
-  @name define_library_path
-  @parameters char *path
-  @description Adds an library path to the build configuration
-  @returns int
+  @name command_render
+  @parameters Command *command
+  @description Renders an argv vector as a shell-like string for logs and build signatures
+  @returns char *
 */
-int define_library_path(const char *path) {
-    library_paths = realloc(library_paths, sizeof(Entry) * (num_library_paths + 1));
-    if (!library_paths) return S_ERROR;
-    library_paths[num_library_paths].key = strdup(path);
-    if (!library_paths[num_library_paths].key) return S_ERROR;
-    library_paths[num_library_paths].value = NULL;
-    num_library_paths++;
-    return 0;
+char *command_render(const Command *command) {
+    size_t length = 1;
+    for (size_t i = 0; i < command->count; i++) length += strlen(command->items[i]) * 2 + 3;
+    char *rendered = malloc(length);
+    if (!rendered) exit_error(__func__, "Memory allocation failed");
+
+    char *out = rendered;
+    for (size_t i = 0; i < command->count; i++) {
+        const char *arg = command->items[i];
+        if (i > 0) *out++ = ' ';
+        if (*arg != '\0' && strpbrk(arg, " \t\n\"'\\$`*?;&|<>()#") == NULL) {
+            size_t arg_length = strlen(arg);
+            memcpy(out, arg, arg_length);
+            out += arg_length;
+        } else {
+            char *escaped = escape_argument(arg);
+            if (!escaped) exit_error(__func__, "Memory allocation failed");
+            size_t escaped_length = strlen(escaped);
+            memcpy(out, escaped, escaped_length);
+            out += escaped_length;
+            free(escaped);
+        }
+    }
+    *out = '\0';
+    return rendered;
 }
 
 /*
-  @name add_flag
-  @parameters char *flag
-  @description Adds an flag to the build configuration
-  @returns int
+  @name command_free
+  @parameters Command *command
+  @description Frees an argv vector
+  @returns void
 */
-int add_flag(const char *flag) {
-    char **temp = realloc(flags, sizeof(char *) * (num_flags + 1));
-    if (!temp) return S_ERROR;
-    flags = temp;
-    flags[num_flags] = strdup(flag);
-    if (!flags[num_flags]) return S_ERROR;
-    num_flags++;
-    return 0;
+void command_free(Command *command) {
+    for (size_t i = 0; i < command->count; i++) free(command->items[i]);
+    free(command->items);
+    command->items = NULL;
+    command->count = command->capacity = 0;
 }
 
 /*
-  @name remove_flag
-  @parameters char *flag
-  @description Removes a flag from the build configuration
+  @name spawn_and_wait
+  @parameters Command *command, ProcessResult *result, bool quiet
+  @description PRIVATE FUNCTION | posix_spawnp + wait4, quiet sends stdout/stderr to /dev/null
   @returns int
 */
-int remove_flag(const char *flag) {
-    int index = -1;
-    for (int i = 0; i < num_flags; i++) {
-        if (strcmp(flags[i], flag) == 0) {
-            index = i;
-            break;
-        }
+static int spawn_and_wait(const Command *command, ProcessResult *result, bool quiet) {
+    ProcessResult local;
+    if (!result) result = &local;
+    memset(result, 0, sizeof(*result));
+    result->exit_status = S_ERROR;
+    if (command->count == 0) return S_ERROR;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (quiet) {
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+        posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
     }
 
-    if (index == -1) return S_ERROR;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-    free(flags[index]);
-
-    for (int i = index; i < num_flags - 1; i++) {
-        flags[i] = flags[i + 1];
+    fflush(stdout);
+    pid_t pid;
+    int error = posix_spawnp(&pid, command->items[0], &actions, NULL, command->items, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0) {
+        if (!quiet) fprintf(stderr, "Error: Unable to start '%s': %s\n", command->items[0], strerror(error));
+        return S_ERROR;
     }
 
-    num_flags--;
+    int status;
+    while (wait4(pid, &status, 0, &result->usage) < 0) {
+        if (errno != EINTR) return S_ERROR;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    result->wall_seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
 
-    char **temp = realloc(flags, sizeof(char *) * num_flags);
-    if (!temp && num_flags > 0) return S_ERROR;
-    flags = temp;
+    if (WIFEXITED(status)) result->exit_status = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status)) result->exit_status = 128 + WTERMSIG(status);
+    return result->exit_status;
+}
 
-    return 0;
+/*
+  @name run_process
+  @parameters Command *command, ProcessResult *result
+  @description Runs argv without a shell and waits for it | result (may be NULL) receives exit status, wall time and rusage
+  @returns int | exit status of the process
+*/
+int run_process(const Command *command, ProcessResult *result) {
+    return spawn_and_wait(command, result, false);
 }
 
+/*
+  @name run_process_quiet
+  @parameters Command *command
+  @description Same as run_process but discards the output of the process
+  @returns int
+*/
+int run_process_quiet(const Command *command) {
+    return spawn_and_wait(command, NULL, true);
+}
 
 /*
-  @name remove_library
-  @parameters char *library
-  @description Removes a library from the list of libraries.
-  @returns void
+  @name run_process_capture
+  @parameters Command *command, char **output
+  @description Runs command and stores everything it printed to stdout in *output (malloc'd, full length), stderr is discarded
+  @returns int
 */
-void remove_library(const char *library) {
-    for (size_t i = 0; i < num_libraries; i++) {
-        if (strcmp(libraries[i].key, library) == 0) {
-            free(libraries[i].key);
-            libraries[i] = libraries[--num_libraries];
-            return;
+int run_process_capture(const Command *command, char **output) {
+    *output = NULL;
+    if (command->count == 0) return S_ERROR;
+
+    int fds[2];
+    if (pipe(fds) != 0) return S_ERROR;
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+
+    pid_t pid;
+    int error = posix_spawnp(&pid, command->items[0], &actions, NULL, command->items, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (error != 0) {
+        close(fds[0]);
+        return S_ERROR;
+    }
+
+    size_t length = 0, capacity = 256;
+    char *buffer = malloc(capacity);
+    for (;;) {
+        if (buffer && length + 1 == capacity) {
+            char *temp = realloc(buffer, capacity * 2);
+            if (!temp) {
+                free(buffer);
+                buffer = NULL;
+            } else {
+                buffer = temp;
+                capacity *= 2;
+            }
+        }
+        char discard[256];
+        ssize_t got = buffer ? read(fds[0], buffer + length, capacity - length - 1) : read(fds[0], discard, sizeof(discard));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        if (buffer) length += (size_t)got;
+    }
+    close(fds[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            free(buffer);
+            return S_ERROR;
         }
     }
+    if (buffer) buffer[length] = '\0';
+    *output = buffer;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
 }
 
+// -- Build Trace --
+// INFO: Chrome / Perfetto trace-event JSON of every command samba runs (see enable_trace)
+static int trace_fd = -1;
+static pid_t trace_owner = 0; // the process that opened the trace closes it
+static __thread int worker_slot = 0; // shown as the thread of an event
+
 /*
-  @name remove_include
-  @parameters char *include_path
-  @description Removes an include path from the list of include paths.
+  @name trace_now
+  @parameters void
+  @description Wall clock in microseconds, comparable between the processes of one build
+  @returns long long
+*/
+long long trace_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/*
+  @name trace_write_string
+  @parameters FILE *out, char *string
+  @description PRIVATE FUNCTION | Writes string as a JSON string literal
   @returns void
 */
-void remove_include(const char *include_path) {
-    for (size_t i = 0; i < num_includes; i++) {
-        if (strcmp(includes[i].key, include_path) == 0) {
-            free(includes[i].key);
-            includes[i] = includes[--num_includes];
-            return;
-        }
+static void trace_write_string(FILE *out, const char *string) {
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char *)string; *c; c++) {
+        if (*c == '"' || *c == '\\') fprintf(out, "\\%c", *c);
+        else if (*c < 0x20) fprintf(out, "\\u%04x", *c);
+        else fputc(*c, out);
     }
+    fputc('"', out);
 }
 
 /*
-  @name remove_library_path
-  @parameters char *tool
-  @description Removes a library path from the list of library paths.
+  @name trace_append
+  @parameters char *event, size_t length
+  @description PRIVATE FUNCTION | Appends one event line, a single write so parallel processes never interleave
   @returns void
 */
-void remove_library_path(const char *path) {
-    for (size_t i = 0; i < num_library_paths; i++) {
-        if (strcmp(library_paths[i].key, path) == 0) {
-            free(library_paths[i].key);
-            library_paths[i] = library_paths[--num_library_paths];
-            return;
-        }
+static void trace_append(const char *event, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(trace_fd, event, length);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return;
+        event += written;
+        length -= (size_t)written;
     }
 }
 
-
 /*
-  @name remove_variable
-  @parameters char *var_name
-  @description Removes a Variable from Built Binary
+  @name enable_trace
+  @parameters char *path
+  @description Starts writing a trace of the build to path, open it in ui.perfetto.dev or chrome://tracing
   @returns int
 */
-int remove_variable(const char *var_name) {
-    int index = -1;
-    for (int i = 0; i < num_variables; i++) {
-        if (strcmp(variables[i].key, var_name) == 0) {
-            index = i;
-            break;
-        }
-    }
-
-    if (index == -1) return S_ERROR;
-
-    free(variables[index].key);
-    free(variables[index].value);
-
-    for (int i = index; i < num_variables - 1; i++) {
-        variables[i] = variables[i + 1];
+int enable_trace(const char *path) {
+    if (trace_fd >= 0) close(trace_fd);
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (trace_fd < 0) {
+        fprintf(stderr, "Error: Unable to open trace file '%s': %s\n", path, strerror(errno));
+        return S_ERROR;
     }
-
-    num_variables--;
-    variables = realloc(variables, sizeof(Entry) * num_variables);
-    if (!variables && num_variables > 0) return S_ERROR;
-
+    trace_owner = getpid();
+    trace_append("[\n", 2);
     return 0;
 }
 
-
 /*
-  @name build_directory_exists
-  @parameters char *path
-  @description PRIVATE FUNCTION
-  @returns bool
+  @name trace_event
+  @parameters char *category, char *name, char *command, long long start, ProcessResult *result, bool cache_hit
+  @description Records an action that started at start (trace_now) and ends now, result may be NULL
+  @returns void
 */
-static bool build_directory_exists(const char *path) {
-     struct stat info;
-     return (stat(path, &info) == 0 && (info.st_mode & S_IFDIR));
+void trace_event(const char *category, const char *name, const char *command, long long start,
+                 const ProcessResult *result, bool cache_hit) {
+    if (trace_fd < 0) return;
+    long long end = trace_now();
+
+    char *event = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&event, &length);
+    if (!out) return;
+    fprintf(out, "{\"name\":");
+    trace_write_string(out, name);
+    fprintf(out, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%ld,\"tid\":%d,\"args\":{",
+            category, start, end - start, (long)getpid(), worker_slot);
+    if (command) {
+        fprintf(out, "\"command\":");
+        trace_write_string(out, command);
+        fputc(',', out);
+    }
+    if (result) {
+        fprintf(out, "\"exit\":%d,\"max_rss_kb\":%ld,", result->exit_status, result->usage.ru_maxrss);
+    }
+    fprintf(out, "\"cache_hit\":%s}},\n", cache_hit ? "true" : "false");
+    if (fclose(out) == 0) trace_append(event, length);
+    free(event);
 }
 
 /*
-  @name check_tool
-  @parameters char *tool
-  @description Checks if a tool is installed on the system.
-  @returns bool
-*/
-bool check_tool(const char *tool) {
-    char command[256];
-    snprintf(command, sizeof(command), "which %s > /dev/null 2>&1", tool);
-    return (system(command) == 0);
-}
-
-/*
-  @name compile
-  @parameters char *script_file, char *output_file, bool create_shared
-  @description Compiles a script file into an executable file with all given configuration.
+  @name trace_process_name
+  @parameters char *name
+  @description Names the current process in the trace, e.g. after the build.samba target it builds
   @returns void
 */
-void compile(const char *script_file, const char *output_file, bool create_shared) {
-    #ifdef S_CACHE_COMPILATION
-        if (!check_tool("ccache")) {
-            if (check_tool("dnf")) {
-                system("sudo dnf install ccache -y");
-                system("clear");
-            }
-            else if (check_tool("apt-get")) {
-                system("sudo apt-get install ccache");
-                system("clear");
-            }
-            else {
-                printf("ccache not found. Please install ccache.\n");
-                return;
-            }
-        }
-    #endif
-    char command[4096];
-    snprintf(command, sizeof(command), "%s ", S_COMPILER);
-
-    for (size_t i = 0; i < num_variables; i++) {
-            snprintf(command + strlen(command), sizeof(command) - strlen(command), "-D%s='\"%s\"' ", variables[i].key, variables[i].value);
-    }
-    for (size_t i = 0; i < num_includes; i++) {
-        snprintf(command + strlen(command), sizeof(command) - strlen(command), "-I%s ", includes[i].key);
-    }
-    for (size_t i = 0; i < num_library_paths; i++) {
-        snprintf(command + strlen(command), sizeof(command) - strlen(command), "-L%s ", library_paths[i].key);
-    }
-    for (size_t i = 0; i < num_libraries; i++) {
-        snprintf(command + strlen(command), sizeof(command) - strlen(command), "-l%s ", libraries[i].key);
-    }
-    for (size_t i = 0; i < num_flags; i++) {
-        snprintf(command + strlen(command), sizeof(command) - strlen(command), "%s ", flags[i]);
-    }
-    if (create_shared) {
-        snprintf(command + strlen(command), sizeof(command) - strlen(command), "-shared ");
-    }
-    if (build_directory == NULL) {
-        snprintf(command + strlen(command), sizeof(command) - strlen(command), "-o %s %s", output_file, script_file);
-    }
-    else {
-        snprintf(command + strlen(command), sizeof(command) - strlen(command), "-o %s/%s %s", build_directory, output_file, script_file);
-        if (!build_directory_exists(build_directory)) {
-            if (verbose_mode) {
-            printf("Build directory '%s' does not exist. Creating it...\n", build_directory);
-            }
-            if (mkdir(build_directory, 0755) != 0) {
-                exit_error(__func__, "Failed to create build directory");
-            }
-            verbose_log("Build directory created successfully.\n");
-        }
-    }
-
-
-    verbose_log("Executing command: %s\n", command);
-    if (system(command) != 0) {
-        fprintf(stderr, "Error: Compilation failed.\n");
-    } else {
-        printf("Compilation successful: %s\n", output_file);
-    }
+void trace_process_name(const char *name) {
+    if (trace_fd < 0) return;
+    char *event = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&event, &length);
+    if (!out) return;
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"args\":{\"name\":", (long)getpid());
+    trace_write_string(out, name);
+    fprintf(out, "}},\n");
+    if (fclose(out) == 0) trace_append(event, length);
+    free(event);
 }
 
 /*
-  @name free_all
+  @name finish_trace
   @parameters void
-  @description Frees All
+  @description Closes the JSON array of the trace, only the process that called enable_trace does so
   @returns void
 */
-void free_all() {
-    for (size_t i = 0; i < num_libraries; i++) free(libraries[i].key);
-    free(libraries);
-    for (size_t i = 0; i < num_includes; i++) free(includes[i].key);
-    free(includes);
-    for (size_t i = 0; i < num_library_paths; i++) free(library_paths[i].key);
-    free(library_paths);
-    for (size_t i = 0; i < num_flags; i++) free(flags[i]);
-    free(flags);
-    libraries = includes = library_paths = NULL;
-    flags = NULL;
-    num_libraries = num_includes = num_library_paths = num_flags = 0;
+void finish_trace() {
+    if (trace_fd < 0 || getpid() != trace_owner) return;
+    char event[128];
+    int length = snprintf(event, sizeof(event), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"args\":{\"name\":\"samba\"}}\n]\n",
+                          (long)getpid());
+    trace_append(event, (size_t)length);
+    close(trace_fd);
+    trace_fd = -1;
 }
 
 /*
-  @name reset_settings
-  @parameters void
-  @description Frees All | Is made if your wanna make 2 targets or more with different flags
-  @returns void
+  @name run_args
+  @parameters char *arg, ...
+  @description Runs a NULL terminated argument list, e.g. run_args("rm", "-rf", path, NULL)
+  @returns int
 */
-void reset_settings() {
-    free_all();
-    #undef verbose_mode
-    #define verbose_mode false
+int run_args(const char *arg, ...) {
+    Command command = {0};
+    va_list args;
+    va_start(args, arg);
+    for (const char *a = arg; a; a = va_arg(args, const char *)) command_push(&command, a);
+    va_end(args);
+
+    char *rendered = (verbose_mode || trace_fd >= 0) ? command_render(&command) : NULL;
+    if (rendered) verbose_log("Executing command: %s\n", rendered);
+    long long start = trace_now();
+    ProcessResult result;
+    int status = run_process(&command, &result);
+    if (rendered) trace_event("shell", rendered, rendered, start, &result, false);
+    free(rendered);
+    command_free(&command);
+    return status;
 }
 
 /*
-  @name needs_rebuild
-  @parameters char *source_file, char *executable
-  @description Used in SAMBA_GO_REBUILD_URSELF | you can also use it
+  @name define_variable
+  @parameters char *var_name, char *var_value
+  @description Adds an Variable to Built Binary
   @returns int
 */
-int needs_rebuild(const char *source_file, const char *executable) {
-    struct stat source_stat, exe_stat;
-
-    if (stat(source_file, &source_stat) != 0) {
-        fprintf(stderr, "Error: Source file '%s' not found.\n", source_file);
-        return 1;
-    }
-
-    if (stat(executable, &exe_stat) != 0) {
-        fprintf(stderr, "Warning: Executable '%s' not found.\n", executable);
-        return 1;
+int define_variable(const char *var_name, const char *var_value) {
+    size_t position;
+    if (settings_index_find(&variables_index, variables, sizeof(Entry), var_name, &position)) {
+        char *value = settings_string(var_value);
+        if (!value) return S_ERROR;
+        variables[position].value = value;
+        return 0;
     }
+    if (settings_reserve((void **)&variables, num_variables, &variables_capacity, sizeof(Entry)) != 0) return S_ERROR;
+    variables[num_variables].key = settings_string(var_name);
+    variables[num_variables].value = settings_string(var_value);
+    if (!variables[num_variables].key || !variables[num_variables].value) return S_ERROR;
+    num_variables++;
+    return settings_index_add(&variables_index, variables, sizeof(Entry), num_variables - 1);
+}
 
-    if (source_stat.st_mtime > exe_stat.st_mtime) {
-        #ifndef S_REBUILD_NO_OUTPUT
-            verbose_log("Source file '%s' is newer than executable '%s'. Rebuild required.\n", source_file, executable);
-        #endif
-
-        return 1;
+/*
+  @name define_library
+  @parameters char *library
+  @description Adds an Library to the build configuration
+  @returns int
+*/
+int define_library(const char *library) {
+    // Like pkg-config the last -l wins, so a library stays behind everything that was added before it and needs it
+    size_t position;
+    if (settings_index_find(&libraries_index, libraries, sizeof(Entry), library, &position)) {
+        if (position == num_libraries - 1) return 0;
+        if (settings_remove_at(&libraries_index, libraries, sizeof(Entry), &num_libraries, position, NULL) != 0) return S_ERROR;
     }
-
-    #ifndef S_REBUILD_NO_OUTPUT
-        verbose_log("Executable '%s' is up-to-date. Running...\n", executable);
-    #endif
-    return 0;
+    if (settings_reserve((void **)&libraries, num_libraries, &libraries_capacity, sizeof(Entry)) != 0) return S_ERROR;
+    libraries[num_libraries].key = settings_string(library);
+    if (!libraries[num_libraries].key) return S_ERROR;
+    libraries[num_libraries].value = NULL;
+    num_libraries++;
+    return settings_index_add(&libraries_index, libraries, sizeof(Entry), num_libraries - 1);
 }
 
 /*
-  @name file_exists
-  @parameters char *path
-  @description Checks if the given file exists
-  @returns bool
+  @name define_include
+  @parameters char *include_path
+  @description Adds an Include to the build configuration
+  @returns int
 */
-bool file_exists(const char *path) {
-    struct stat buffer;
-    return (stat(path, &buffer) == 0);
+int define_include(const char *include_path) {
+    if (settings_index_find(&includes_index, includes, sizeof(Entry), include_path, NULL)) return 0;
+    if (settings_reserve((void **)&includes, num_includes, &includes_capacity, sizeof(Entry)) != 0) return S_ERROR;
+    includes[num_includes].key = settings_string(include_path);
+    if (!includes[num_includes].key) return S_ERROR;
+    includes[num_includes].value = NULL;
+    num_includes++;
+    return settings_index_add(&includes_index, includes, sizeof(Entry), num_includes - 1);
 }
 
 /*
-  @name SAMBA_GO_REBUILD_URSELF
-  @parameters void
-  @description Checks if the samba.c binary is uptodate | Idea taken from tsoding | Implementation self made
-  @returns void
+  @name define_library_path
+  @parameters char *path
+  @description Adds an library path to the build configuration
+  @returns int
 */
-void SAMBA_GO_REBUILD_URSELF() {
-    const char *source_file = "samba.c";
-    const char *executable = "samba";
-
-    if (needs_rebuild(source_file, executable) == 1) {
-        const char *build_command = "gcc -o samba samba.c -O2 -DNDEBUG -s";
-
-        #ifndef S_REBUILD_NO_OUTPUT
-            verbose_log("Rebuilding '%s' from source '%s'.\n", executable, source_file);
-        #endif
-        if (system(build_command) != 0) {
-            exit_error(__func__, "Build failed\n");
-        }
-
-        #ifndef S_REBUILD_NO_OUTPUT
-            verbose_log("Build completed successfully.\n");
-        #endif
-
-        system("clear");
-
-        const char *run_command = "./samba";
-        #ifndef S_REBUILD_NO_OUTPUT
-            verbose_log("Executing '%s'...\n", executable);
-        #endif
-        if (system(run_command) != 0) {
-            exit_error(__func__, "Execution failed\n");
-        }
-    }
+int define_library_path(const char *path) {
+    if (settings_index_find(&library_paths_index, library_paths, sizeof(Entry), path, NULL)) return 0;
+    if (settings_reserve((void **)&library_paths, num_library_paths, &library_paths_capacity, sizeof(Entry)) != 0) return S_ERROR;
+    library_paths[num_library_paths].key = settings_string(path);
+    if (!library_paths[num_library_paths].key) return S_ERROR;
+    library_paths[num_library_paths].value = NULL;
+    num_library_paths++;
+    return settings_index_add(&library_paths_index, library_paths, sizeof(Entry), num_library_paths - 1);
 }
 
 /*
-  @name initialize_build_flags
-  @parameters void
-  @description Inits the build flags (S_RELEASE_MODE or S_DEBUG_MODE)
-  @returns void
+  @name add_flag_word
+  @parameters char *flag
+  @description PRIVATE FUNCTION | Adds one argv element to the flags, callers have already split it | a repeated -I or -L path keeps its first place (the first one is searched first), any other repeated flag moves to the end so the last of -O2 -O0 -O2 still wins
+  @returns int
 */
-void initialize_build_flags() {
-    // Modes
-    #ifdef S_RELEASE_MODE
-        add_flag("-O2");
-        add_flag("-DNDEBUG");
-        add_flag("-s");
-    #endif
-
-    #ifdef S_DEBUG_MODE
-        add_flag("-O0");
-        add_flag("-g");
-    #endif
-
-    // Integrate Samba Vars to the output executable
-    define_variable("S_VERSION", S_VERSION);
-    define_variable("S_COMPILER", S_COMPILER);
+static int add_flag_word(const char *flag) {
+    bool argument = flag_takes_argument(flag_before(num_flags));
+    size_t position;
+    if (!argument && settings_index_find(&flags_index, flags, sizeof(char *), flag, &position)) {
+        if (strncmp(flag, "-I", 2) == 0 || strncmp(flag, "-L", 2) == 0) return 0;
+        if (flags[position] == flag_before(num_flags)) return 0;
+        if (settings_remove_at(&flags_index, flags, sizeof(char *), &num_flags, position, flag_indexed) != 0) return S_ERROR;
+    }
+    if (settings_reserve((void **)&flags, num_flags, &flags_capacity, sizeof(char *)) != 0) return S_ERROR;
+    flags[num_flags] = settings_string(flag);
+    if (!flags[num_flags]) return S_ERROR;
+    num_flags++;
+    if (!flag_indexed(num_flags - 1)) return 0;
+    return settings_index_add(&flags_index, flags, sizeof(char *), num_flags - 1);
 }
 
 /*
-  @name find_library
-  @parameters char *library
-  @description Finds libs for the given library using pkg-config
-  @returns char *
+  @name add_flag
+  @parameters char *flag
+  @description Adds an flag to the build configuration | several words are split like the shell would, e.g. add_flag("-Wall -Wextra") or add_flag(find_flags("gtk+-3.0"))
+  @returns int
 */
-char *find_library(const char *library) {
-    char command[256];
-    snprintf(command, sizeof(command), "pkg-config --libs %s", library);
-    FILE *pipe = popen(command, "r");
-    if (!pipe) return NULL;
-
-    char *result = malloc(128);
-    fgets(result, 128, pipe);
-    pclose(pipe);
+int add_flag(const char *flag) {
+    if (!flag) return S_ERROR;
+    if (!strpbrk(flag, " \t\n\"'\\")) return add_flag_word(flag);
+    Command words = {0};
+    command_push_split(&words, flag);
+    int result = 0;
+    for (size_t i = 0; i < words.count && result == 0; i++) result = add_flag_word(words.items[i]);
+    command_free(&words);
     return result;
 }
 
 /*
-  @name find_flags
-  @parameters char *library
-  @description Finds flags for the given library using pkg-config
-  @returns char *
+  @name remove_flag_word
+  @parameters char *flag
+  @description PRIVATE FUNCTION | Removes one argv element from the flags
+  @returns int
 */
-char *find_flags(const char *library) {
-    char command[256];
-    snprintf(command, sizeof(command), "pkg-config --cflags %s", library);
-    FILE *pipe = popen(command, "r");
-    if (!pipe) return NULL;
-
-    char *result = malloc(128);
-    fgets(result, 128, pipe);
-    pclose(pipe);
-    return result;
+static int remove_flag_word(const char *flag) {
+    size_t index;
+    if (!settings_index_find(&flags_index, flags, sizeof(char *), flag, &index)) {
+        // Flags that take an argument are not indexed
+        for (index = 0; index < num_flags && (!flags[index] || strcmp(flags[index], flag) != 0); index++);
+        if (index == num_flags) return S_ERROR;
+    }
+
+    return settings_remove_at(&flags_index, flags, sizeof(char *), &num_flags, index, flag_indexed);
 }
 
 /*
-  @name s_command
-  @parameters char *fmt, ...
-  @description Simple function for executing an command (using the system function) and loging if verbose mode is enabled also supports fmt
+  @name remove_flag
+  @parameters char *flag
+  @description Removes a flag from the build configuration | several words are split like in add_flag
   @returns int
 */
-int s_command(char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    char command[256];
-    vsnprintf(command, sizeof(command), fmt, args);
-    verbose_log("Executing command: %s\n", command);
-    va_end(args);
-    return system(command);
+int remove_flag(const char *flag) {
+    if (!flag) return S_ERROR;
+    if (!strpbrk(flag, " \t\n\"'\\")) return remove_flag_word(flag);
+    Command words = {0};
+    command_push_split(&words, flag);
+    int result = words.count > 0 ? 0 : S_ERROR;
+    for (size_t i = 0; i < words.count; i++) {
+        if (remove_flag_word(words.items[i]) != 0) result = S_ERROR;
+    }
+    command_free(&words);
+    return result;
 }
 
-//////////////////////////////////////////////////
-//////////////////////////////////////////////////
-               // V 1.1
-//////////////////////////////////////////////////
-//////////////////////////////////////////////////
 
 /*
-  @name set_build_directory
-  @parameters char *path
-  @description Sets the build directory to the given path
+  @name remove_library
+  @parameters char *library
+  @description Removes a library from the list of libraries, the link order of the others is kept.
   @returns void
 */
-void set_build_directory(const char *path) {
-    build_directory = NULL;
-    build_directory = strdup(path);
-    if (!build_directory) {
-        exit_error(__func__, "Failed to set build directory");
-    }
+void remove_library(const char *library) {
+    size_t position;
+    if (!settings_index_find(&libraries_index, libraries, sizeof(Entry), library, &position)) return;
+    settings_remove_at(&libraries_index, libraries, sizeof(Entry), &num_libraries, position, NULL);
 }
 
 /*
-  @name print_libraries
-  @parameters void
-  @description Prints the libraries
+  @name remove_include
+  @parameters char *include_path
+  @description Removes an include path from the list of include paths, the search order of the others is kept.
   @returns void
 */
-void print_libraries() {
-    printf("Libraries:\n");
-    for (size_t i = 0; i < num_libraries; i++) {
-        printf(" - %s\n", libraries[i].key);
-    }
+void remove_include(const char *include_path) {
+    size_t position;
+    if (!settings_index_find(&includes_index, includes, sizeof(Entry), include_path, &position)) return;
+    settings_remove_at(&includes_index, includes, sizeof(Entry), &num_includes, position, NULL);
 }
 
 /*
-  @name create_build_directory
-  @parameters void
-  @description Clears the build directory
+  @name remove_library_path
+  @parameters char *tool
+  @description Removes a library path from the list of library paths, the search order of the others is kept.
   @returns void
 */
-void clear_build_directory() {
-    char command[256];
-
-    snprintf(command, sizeof(command), "rm -rf %s", build_directory);
+void remove_library_path(const char *path) {
+    size_t position;
+    if (!settings_index_find(&library_paths_index, library_paths, sizeof(Entry), path, &position)) return;
+    settings_remove_at(&library_paths_index, library_paths, sizeof(Entry), &num_library_paths, position, NULL);
+}
 
-    verbose_log("Clearing build directory: %s\n", command);
 
-    int result = system(command);
-    if (result != 0) {
-        fprintf(stderr, "Error: Failed to clear build directory.\n");
-    }
+/*
+  @name remove_variable
+  @parameters char *var_name
+  @description Removes a Variable from Built Binary
+  @returns int
+*/
+int remove_variable(const char *var_name) {
+    size_t index;
+    if (!settings_index_find(&variables_index, variables, sizeof(Entry), var_name, &index)) return S_ERROR;
 
+    return settings_remove_at(&variables_index, variables, sizeof(Entry), &num_variables, index, NULL);
 }
 
+
 /*
-  @name generate_build_report_to_file
-  @parameters char *filename
-  @description Generates a build report and writes it to a file
-  @returns void
+  @name build_directory_exists
+  @parameters char *path
+  @description PRIVATE FUNCTION
+  @returns bool
 */
-void generate_build_report_to_file(const char *filename) {
-    verbose_log("Generating build report to file: %s\n", filename);
-    FILE *file = fopen(filename, "w");
+static bool build_directory_exists(const char *path) {
+     struct stat info;
+     return (stat(path, &info) == 0 && (info.st_mode & S_IFDIR));
+}
 
-    if (file == NULL) {
-        fprintf(stderr, "Error: Unable to open file %s for writing.\n", filename);
-        return;
+/*
+  @name read_file_contents
+  @parameters char *path, size_t *length
+  @description PRIVATE FUNCTION | Reads a whole file into a NUL terminated buffer
+  @returns char *
+*/
+static char *read_file_contents(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    if (fseek(file, 0, SEEK_END) != 0) { fclose(file); return NULL; }
+    long size = ftell(file);
+    if (size < 0) { fclose(file); return NULL; }
+    rewind(file);
+
+    char *buffer = malloc((size_t)size + 1);
+    if (!buffer) { fclose(file); return NULL; }
+
+    size_t read = fread(buffer, 1, (size_t)size, file);
+    fclose(file);
+    buffer[read] = '\0';
+    if (length) *length = read;
+    return buffer;
+}
+
+/*
+  @name write_file_atomically
+  @parameters char *path, char *data, size_t length
+  @description PRIVATE FUNCTION | Writes data to a temporary file and renames it over path, readers never see a partial file
+  @returns int
+*/
+static int write_file_atomically(const char *path, const char *data, size_t length) {
+    // A cut off suffix would let concurrent writers share one temp file
+    char temp_path[PATH_MAX + 64];
+    int needed = snprintf(temp_path, sizeof(temp_path), "%s.%ld.%lx.tmp", path, (long)getpid(), (unsigned long)pthread_self());
+    if (needed < 0 || (size_t)needed >= sizeof(temp_path)) return S_ERROR;
+    FILE *file = fopen(temp_path, "wb");
+    if (!file) return S_ERROR;
+    bool written = fwrite(data, 1, length, file) == length;
+    if (fclose(file) != 0 || !written || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+        return S_ERROR;
     }
+    return 0;
+}
 
-    fprintf(file, "Build Configuration Report:\n");
-    fprintf(file, "- Compiler: %s\n", S_COMPILER);
-    fprintf(file, "- Flags: ");
-    if (num_flags == 0) {
-        fprintf(file, "\n  - None\n");
-    } else {
-        for (size_t i = 0; i < num_flags; i++) {
-            fprintf(file, "\n  - %s", flags[i]);
+/*
+  @name is_newer
+  @parameters struct stat *a, struct stat *b
+  @description PRIVATE FUNCTION | Nanosecond precise "a was modified after b"
+  @returns bool
+*/
+static bool is_newer(const struct stat *a, const struct stat *b) {
+    if (a->st_mtim.tv_sec != b->st_mtim.tv_sec) return a->st_mtim.tv_sec > b->st_mtim.tv_sec;
+    return a->st_mtim.tv_nsec > b->st_mtim.tv_nsec;
+}
+
+/*
+  @name read_depfile
+  @parameters char *depfile, size_t *count
+  @description PRIVATE FUNCTION | Parses a make style depfile (-MMD -MF) and returns the listed prerequisites
+  @returns char **
+*/
+static char **read_depfile(const char *depfile, size_t *count) {
+    *count = 0;
+    char *contents = read_file_contents(depfile, NULL);
+    if (!contents) return NULL;
+
+    char **deps = NULL;
+    size_t capacity = 0;
+    bool seen_target = false;
+    char path[PATH_MAX];
+    size_t path_len = 0;
+    char *in = contents;
+
+    for (;;) {
+        char c = *in;
+        bool end_of_token = (c == '\0' || c == ' ' || c == '\t' || c == '\n' || c == '\r');
+
+        if (c == '\\' && (in[1] == '\n' || in[1] == '\r')) {
+            in += (in[1] == '\r' && in[2] == '\n') ? 3 : 2;
+            end_of_token = true;
+            c = ' ';
+        } else if (c == '\\' && (in[1] == ' ' || in[1] == '#' || in[1] == '\\')) {
+            if (path_len < sizeof(path) - 1) path[path_len++] = in[1];
+            in += 2;
+            continue;
+        } else if (c == '$' && in[1] == '$') {
+            if (path_len < sizeof(path) - 1) path[path_len++] = '$';
+            in += 2;
+            continue;
+        } else if (!end_of_token) {
+            if (path_len < sizeof(path) - 1) path[path_len++] = c;
+            in++;
+            continue;
+        } else if (c != '\0') {
+            in++;
         }
-    }
 
-    fprintf(file, "\n- Libraries: ");
-    if (num_libraries == 0) {
-        fprintf(file, "\n  - None\n");
-    } else {
-        for (size_t i = 0; i < num_libraries; i++) {
-            fprintf(file, "\n  - %s", libraries[i].key);
+        if (path_len > 0) {
+            path[path_len] = '\0';
+            if (!seen_target) {
+                if (path[path_len - 1] == ':') seen_target = true;
+            } else if (strcmp(path, ":") != 0) {
+                if (*count == capacity) {
+                    capacity = capacity ? capacity * 2 : 16;
+                    char **temp = realloc(deps, sizeof(char *) * capacity);
+                    if (!temp) break;
+                    deps = temp;
+                }
+                deps[(*count)++] = strdup(path);
+            }
+            path_len = 0;
         }
+        if (c == '\0') break;
     }
-    fprintf(file, "\n- Includes: ");
-    if (num_includes == 0) {
-        fprintf(file, "\n  - None\n");
-    } else {
-        for (size_t i = 0; i < num_includes; i++) {
-            fprintf(file, "\n  - %s", includes[i].key);
+
+    free(contents);
+    if (!seen_target) {
+        for (size_t i = 0; i < *count; i++) free(deps[i]);
+        free(deps);
+        *count = 0;
+        return NULL;
+    }
+    if (!deps) deps = calloc(1, sizeof(char *));
+    return deps;
+}
+
+/*
+  @name free_depfile
+  @parameters char **deps, size_t count
+  @description PRIVATE FUNCTION | Frees the result of read_depfile
+  @returns void
+*/
+static void free_depfile(char **deps, size_t count) {
+    for (size_t i = 0; i < count; i++) free(deps[i]);
+    free(deps);
+}
+
+// -- Content Hash Mode --
+// INFO: Trust file contents instead of mtimes (survives git checkout, touch and cache restores)
+#ifdef S_CONTENT_HASH
+    bool content_hash_mode = true;
+#else
+    bool content_hash_mode = false;
+#endif
+
+typedef struct {
+    char *output;
+    char *input;
+    uint64_t hash;
+    long long mtime_sec;
+    long mtime_nsec;
+    long long size;
+    bool dirty; // changed by this process, wins over what other processes saved
+} HashRecord;
+
+static HashRecord *hash_records = NULL;
+static size_t num_hash_records = 0;
+static size_t hash_records_capacity = 0;
+static size_t *hash_index = NULL; // open addressing, stores record index + 1
+static size_t hash_index_capacity = 0;
+static char *hash_db_path = NULL;
+static bool hash_db_dirty = false;
+static pthread_mutex_t hash_db_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+  @name enable_content_hash
+  @parameters void
+  @description Enables content hash rebuild detection (same as defining S_CONTENT_HASH)
+  @returns void
+*/
+void enable_content_hash() {
+    content_hash_mode = true;
+}
+
+/*
+  @name hash_file_pair
+  @parameters char *path, uint64_t *hash, uint64_t *mix
+  @description PRIVATE FUNCTION | hash_bytes of a file, and hash_bytes_mix too unless mix is NULL
+  @returns int
+*/
+static int hash_file_pair(const char *path, uint64_t *hash, uint64_t *mix) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return S_ERROR;
+
+    unsigned char buffer[65536];
+    uint64_t h = S_HASH_SEED, m = S_HASH_MIX_SEED;
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        h = hash_bytes(h, buffer, read);
+        if (mix) m = hash_bytes_mix(m, buffer, read);
+    }
+    bool failed = ferror(file);
+    fclose(file);
+    if (failed) return S_ERROR;
+    *hash = h;
+    if (mix) *mix = m;
+    return 0;
+}
+
+/*
+  @name hash_file
+  @parameters char *path, uint64_t *hash
+  @description Hashes the contents of a file
+  @returns int
+*/
+int hash_file(const char *path, uint64_t *hash) {
+    return hash_file_pair(path, hash, NULL);
+}
+
+typedef struct {
+    char **keys;
+    size_t *values;
+    size_t count;
+    size_t capacity; // power of two, open addressing
+} StringMap;
+
+/*
+  @name string_map_slot
+  @parameters StringMap *map, char *key
+  @description PRIVATE FUNCTION | Slot of key, or of the empty slot where it would go
+  @returns size_t
+*/
+static size_t string_map_slot(const StringMap *map, const char *key) {
+    size_t mask = map->capacity - 1;
+    size_t slot = (size_t)hash_bytes(S_HASH_SEED, key, strlen(key)) & mask;
+    while (map->keys[slot] && strcmp(map->keys[slot], key) != 0) slot = (slot + 1) & mask;
+    return slot;
+}
+
+/*
+  @name string_map_get
+  @parameters StringMap *map, char *key, size_t *value
+  @description Looks up key in a string map
+  @returns bool
+*/
+bool string_map_get(const StringMap *map, const char *key, size_t *value) {
+    if (map->capacity == 0) return false;
+    size_t slot = string_map_slot(map, key);
+    if (!map->keys[slot]) return false;
+    if (value) *value = map->values[slot];
+    return true;
+}
+
+/*
+  @name string_map_put
+  @parameters StringMap *map, char *key, size_t value
+  @description Inserts or updates key in a string map (the key is copied)
+  @returns int
+*/
+int string_map_put(StringMap *map, const char *key, size_t value) {
+    if ((map->count + 1) * 2 > map->capacity) {
+        size_t new_capacity = map->capacity ? map->capacity * 2 : 64;
+        char **keys = calloc(new_capacity, sizeof(char *));
+        size_t *values = calloc(new_capacity, sizeof(size_t));
+        if (!keys || !values) {
+            free(keys);
+            free(values);
+            return S_ERROR;
         }
+        StringMap grown = {keys, values, 0, new_capacity};
+        for (size_t i = 0; i < map->capacity; i++) {
+            if (!map->keys[i]) continue;
+            size_t slot = string_map_slot(&grown, map->keys[i]);
+            grown.keys[slot] = map->keys[i];
+            grown.values[slot] = map->values[i];
+            grown.count++;
+        }
+        free(map->keys);
+        free(map->values);
+        *map = grown;
     }
 
-    fprintf(file, "\n");
+    size_t slot = string_map_slot(map, key);
+    if (!map->keys[slot]) {
+        map->keys[slot] = strdup(key);
+        if (!map->keys[slot]) return S_ERROR;
+        map->count++;
+    }
+    map->values[slot] = value;
+    return 0;
+}
 
-    if (fclose(file) != 0) {
-        fprintf(stderr, "Error: Failed to close file %s.\n", filename);
+/*
+  @name string_map_free
+  @parameters StringMap *map
+  @description Frees a string map
+  @returns void
+*/
+void string_map_free(StringMap *map) {
+    for (size_t i = 0; i < map->capacity; i++) free(map->keys[i]);
+    free(map->keys);
+    free(map->values);
+    memset(map, 0, sizeof(*map));
+}
+
+/*
+  @name hash_db_slot
+  @parameters char *output, char *input
+  @description PRIVATE FUNCTION | Finds the index slot for an (output, input) pair
+  @returns size_t
+*/
+static size_t hash_db_slot(const char *output, const char *input) {
+    uint64_t h = hash_bytes(S_HASH_SEED, output, strlen(output));
+    h = hash_bytes(h, "\t", 1);
+    h = hash_bytes(h, input, strlen(input));
+
+    size_t mask = hash_index_capacity - 1;
+    size_t slot = (size_t)h & mask;
+    while (hash_index[slot] != 0) {
+        HashRecord *record = &hash_records[hash_index[slot] - 1];
+        if (strcmp(record->output, output) == 0 && strcmp(record->input, input) == 0) break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/*
+  @name hash_db_put
+  @parameters char *output, char *input, uint64_t hash, struct stat *st
+  @description PRIVATE FUNCTION | Inserts or updates a record | hash_db_mutex must be held
+  @returns void
+*/
+static void hash_db_put(const char *output, const char *input, uint64_t hash, const struct stat *st) {
+    if ((num_hash_records + 1) * 2 > hash_index_capacity) {
+        size_t new_capacity = hash_index_capacity ? hash_index_capacity * 2 : 256;
+        size_t *new_index = calloc(new_capacity, sizeof(size_t));
+        if (!new_index) return;
+        free(hash_index);
+        hash_index = new_index;
+        hash_index_capacity = new_capacity;
+        for (size_t i = 0; i < num_hash_records; i++) {
+            hash_index[hash_db_slot(hash_records[i].output, hash_records[i].input)] = i + 1;
+        }
+    }
+
+    size_t slot = hash_db_slot(output, input);
+    HashRecord *record;
+    if (hash_index[slot] != 0) {
+        record = &hash_records[hash_index[slot] - 1];
     } else {
-        printf("Build report successfully written to %s.\n", filename);
+        if (num_hash_records == hash_records_capacity) {
+            size_t new_capacity = hash_records_capacity ? hash_records_capacity * 2 : 256;
+            HashRecord *temp = realloc(hash_records, sizeof(HashRecord) * new_capacity);
+            if (!temp) return;
+            hash_records = temp;
+            hash_records_capacity = new_capacity;
+        }
+        record = &hash_records[num_hash_records];
+        record->output = strdup(output);
+        record->input = strdup(input);
+        hash_index[slot] = ++num_hash_records;
     }
+    record->hash = hash;
+    record->mtime_sec = st->st_mtim.tv_sec;
+    record->mtime_nsec = st->st_mtim.tv_nsec;
+    record->size = st->st_size;
+    record->dirty = true;
+    hash_db_dirty = true;
+}
 
-    char command[256];
-    snprintf(command, sizeof(command), "chmod 755 %s", filename);
-    verbose_log("Executing command: %s\n", command);
-    system(command);
+/*
+  @name hash_db_get
+  @parameters char *output, char *input
+  @description PRIVATE FUNCTION | Looks up a record | hash_db_mutex must be held
+  @returns HashRecord *
+*/
+static HashRecord *hash_db_get(const char *output, const char *input) {
+    if (hash_index_capacity == 0) return NULL;
+    size_t slot = hash_db_slot(output, input);
+    return hash_index[slot] ? &hash_records[hash_index[slot] - 1] : NULL;
 }
 
 /*
-  @name generate_timestamp_file
-  @parameters void
-  @description Generates a timestamp file with the current date and time
+  @name hash_db_load
+  @parameters char *path
+  @description PRIVATE FUNCTION | Reads a database file, records changed by this process are kept | hash_db_mutex must be held
   @returns void
 */
-void generate_timestamp_file() {
-    FILE *file = fopen("build.timestamp", "w");
-    if (file) {
-        time_t now = time(NULL);
-        fprintf(file, "Last build: %s", ctime(&now));
+static void hash_db_load(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) return;
+    char line[PATH_MAX * 2 + 128];
+    if (!fgets(line, sizeof(line), file) || strcmp(line, "samba-db 1\n") != 0) {
         fclose(file);
-        verbose_log("Build timestamp generated.\n");
-    } else {
-        fprintf(stderr, "Error generating timestamp file.\n");
+        return;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long long hash;
+        long long mtime_sec, size;
+        long mtime_nsec;
+        int offset = 0;
+        if (sscanf(line, "%llx %lld %ld %lld %n", &hash, &mtime_sec, &mtime_nsec, &size, &offset) != 4) continue;
+        char *output = line + offset;
+        char *tab = strchr(output, '\t');
+        char *newline = strchr(output, '\n');
+        if (!tab || !newline) continue;
+        *tab = '\0';
+        *newline = '\0';
+        HashRecord *record = hash_db_get(output, tab + 1);
+        if (record && record->dirty) continue;
+        struct stat st;
+        st.st_mtim.tv_sec = mtime_sec;
+        st.st_mtim.tv_nsec = mtime_nsec;
+        st.st_size = size;
+        hash_db_put(output, tab + 1, hash, &st);
+        record = hash_db_get(output, tab + 1);
+        if (record) record->dirty = false;
     }
+    fclose(file);
 }
 
 /*
-  @name backup_build_directory
-  @parameters char *backup_dir
-  @description Backups the build_directory to the specified backup_dir
+  @name save_build_database
+  @parameters void
+  @description Writes the content hash database to disk (called automatically at exit)
   @returns void
 */
-void backup_build_directory(const char *backup_dir) {
-    char command[256];
-    snprintf(command, sizeof(command), "cp -r %s %s", build_directory, backup_dir);
-    verbose_log("Executing command: %s\n", command);
-    system(command);
+void save_build_database() {
+    pthread_mutex_lock(&hash_db_mutex);
+    if (hash_db_path && hash_db_dirty) {
+        char lock_path[PATH_MAX + 8], temp_path[PATH_MAX + 32];
+        snprintf(lock_path, sizeof(lock_path), "%s.lock", hash_db_path);
+        snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", hash_db_path, (long)getpid());
+        int lock = open(lock_path, O_RDWR | O_CREAT, 0644);
+        if (lock >= 0) flock(lock, LOCK_EX);
+
+        // Targets of one build run in parallel processes, keep what they saved in the meantime
+        hash_db_load(hash_db_path);
+        FILE *file = fopen(temp_path, "w");
+        if (file) {
+            fprintf(file, "samba-db 1\n");
+            for (size_t i = 0; i < num_hash_records; i++) {
+                HashRecord *r = &hash_records[i];
+                fprintf(file, "%016llx %lld %ld %lld %s\t%s\n", (unsigned long long)r->hash,
+                        r->mtime_sec, r->mtime_nsec, r->size, r->output, r->input);
+            }
+            if (fclose(file) == 0 && rename(temp_path, hash_db_path) == 0) {
+                for (size_t i = 0; i < num_hash_records; i++) hash_records[i].dirty = false;
+                hash_db_dirty = false;
+            } else {
+                unlink(temp_path);
+            }
+        }
+        if (lock >= 0) {
+            flock(lock, LOCK_UN);
+            close(lock);
+        }
+        if (hash_db_dirty) fprintf(stderr, "Warning: Unable to write build database '%s'.\n", hash_db_path);
+    }
+    pthread_mutex_unlock(&hash_db_mutex);
 }
 
-// -- Strip Prefix --
-#ifdef S_STRIP_PREFIX
-    #define AUTO S_AUTO
-    #define CACHE_COMPILATION S_CACHE_COMPILATION
-    #define VERBOSE_MODE S_VERBOSE_MODE
-    #define OS S_OS
-    #define CMP_CLANG S_CMP_CLANG
-    #define RELEASE_MODE S_RELEASE_MODE
-    #define DEBUG_MODE S_DEBUG_MODE
-    #define SUDO S_SUDO
-    #define GO_REBUILD_URSELF SAMBA_GO_REBUILD_URSELF
-#endif
+/*
+  @name hash_db_open
+  @parameters void
+  @description PRIVATE FUNCTION | Loads the database that belongs to the current build_directory | hash_db_mutex must be held
+  @returns void
+*/
+static void hash_db_open() {
+    static bool registered = false;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/.samba_db", build_directory ? build_directory : ".");
+    if (hash_db_path && strcmp(hash_db_path, path) == 0) return;
+
+    if (hash_db_path) {
+        pthread_mutex_unlock(&hash_db_mutex);
+        save_build_database();
+        pthread_mutex_lock(&hash_db_mutex);
+        for (size_t i = 0; i < num_hash_records; i++) {
+            free(hash_records[i].output);
+            free(hash_records[i].input);
+        }
+        free(hash_db_path);
+        num_hash_records = 0;
+        memset(hash_index, 0, sizeof(size_t) * hash_index_capacity);
+    }
+    hash_db_path = strdup(path);
+    if (!registered) {
+        atexit(save_build_database);
+        registered = true;
+    }
 
+    bool dirty = hash_db_dirty;
+    hash_db_load(path);
+    hash_db_dirty = dirty;
+}
 
-// ! WORKS ONLY ON Red Hat based distros and on Debian based distros
 /*
-  @name check_and_install_dependency
-  @parameters char *tool
-  @description Checks if a dependency is installed and installs it if not
+  @name hash_db_matches
+  @parameters char *output, char *input, struct stat *st
+  @description PRIVATE FUNCTION | True if input still has the contents recorded when output was built
+  @returns bool
+*/
+static bool hash_db_matches(const char *output, const char *input, const struct stat *st) {
+    pthread_mutex_lock(&hash_db_mutex);
+    hash_db_open();
+    HashRecord *record = hash_db_get(output, input);
+    bool have_record = record != NULL;
+    uint64_t recorded = have_record ? record->hash : 0;
+    pthread_mutex_unlock(&hash_db_mutex);
+    if (!have_record) return false;
+
+    uint64_t current;
+    if (hash_file(input, &current) != 0 || current != recorded) return false;
+
+    pthread_mutex_lock(&hash_db_mutex);
+    hash_db_put(output, input, current, st);
+    pthread_mutex_unlock(&hash_db_mutex);
+    return true;
+}
+
+/*
+  @name record_build_hashes
+  @parameters char *output, char **inputs, size_t count
+  @description PRIVATE FUNCTION | Records the hashes of inputs and output after a successful build | only rehashes files whose stat changed
   @returns void
 */
-void check_and_install_dependency(const char *tool) {
-    if (!check_tool(tool)) {
-        verbose_log("Dependency '%s' not found. Attempting to install...\n", tool);
-        if (check_tool("dnf")) {
-            char command[256];
-            snprintf(command, sizeof(command), "sudo dnf install -y %s", tool);
-            system(command);
-        } else if (check_tool("apt-get")) {
-            char command[256];
-            snprintf(command, sizeof(command), "sudo apt-get install -y %s", tool);
-            system(command);
-        } else {
-            fprintf(stderr, "Error: Package manager not found. Please install '%s' manually.\n", tool);
+static void record_build_hashes(const char *output, char **inputs, size_t count) {
+    for (size_t i = 0; i <= count; i++) {
+        const char *input = i < count ? inputs[i] : output;
+        struct stat st;
+        if (stat(input, &st) != 0) continue;
+
+        pthread_mutex_lock(&hash_db_mutex);
+        hash_db_open();
+        HashRecord *record = hash_db_get(output, input);
+        bool unchanged = record && record->mtime_sec == st.st_mtim.tv_sec &&
+                         record->mtime_nsec == st.st_mtim.tv_nsec && record->size == st.st_size;
+        pthread_mutex_unlock(&hash_db_mutex);
+        if (unchanged) continue;
+
+        uint64_t hash;
+        if (hash_file(input, &hash) != 0) continue;
+        pthread_mutex_lock(&hash_db_mutex);
+        hash_db_put(output, input, hash, &st);
+        pthread_mutex_unlock(&hash_db_mutex);
+    }
+}
+
+/*
+  @name dependencies_up_to_date
+  @parameters char *output, char **deps, size_t count
+  @description PRIVATE FUNCTION | Checks that no dependency is newer than the output, in content hash mode files that only look dirty are compared by hash
+  @returns bool
+*/
+static bool dependencies_up_to_date(const char *output, char **deps, size_t count) {
+    struct stat output_stat;
+    if (stat(output, &output_stat) != 0) return false;
+
+    bool dirty_by_mtime = false;
+    for (size_t i = 0; i < count; i++) {
+        struct stat dep_stat;
+        if (stat(deps[i], &dep_stat) != 0) {
+            verbose_log("Dependency '%s' is missing.\n", deps[i]);
+            return false;
+        }
+        if (!is_newer(&dep_stat, &output_stat)) continue;
+
+        if (!content_hash_mode || !hash_db_matches(output, deps[i], &dep_stat)) {
+            verbose_log("Dependency '%s' changed.\n", deps[i]);
+            return false;
+        }
+        dirty_by_mtime = true;
+    }
+
+    if (dirty_by_mtime) {
+        // Only the mtimes moved, reuse the output if it is still the one we built
+        if (!hash_db_matches(output, output, &output_stat)) return false;
+        verbose_log("Contents of '%s' unchanged, reusing it.\n", output);
+        utimensat(AT_FDCWD, output, NULL, 0);
+        struct stat touched;
+        if (stat(output, &touched) == 0) {
+            pthread_mutex_lock(&hash_db_mutex);
+            HashRecord *record = hash_db_get(output, output);
+            if (record) hash_db_put(output, output, record->hash, &touched);
+            pthread_mutex_unlock(&hash_db_mutex);
         }
-    } else {
-        verbose_log("Dependency '%s' is already installed.\n", tool);
     }
+    return true;
 }
 
 /*
-  @name interactive_menu
+  @name collect_inputs
+  @parameters char *depfile, char **inputs, size_t num_inputs, size_t *count
+  @description PRIVATE FUNCTION | Depfile entries (if depfile is given) followed by the extra inputs, free with free_depfile
+  @returns char **
+*/
+static char **collect_inputs(const char *depfile, char **inputs, size_t num_inputs, size_t *count) {
+    size_t dep_count = 0;
+    char **deps = NULL;
+    if (depfile) {
+        deps = read_depfile(depfile, &dep_count);
+        if (!deps) return NULL;
+    }
+
+    char **all = realloc(deps, sizeof(char *) * (dep_count + num_inputs + 1));
+    if (!all) {
+        free_depfile(deps, dep_count);
+        return NULL;
+    }
+    for (size_t i = 0; i < num_inputs; i++) all[dep_count + i] = strdup(inputs[i]);
+    *count = dep_count + num_inputs;
+    return all;
+}
+
+/*
+  @name output_up_to_date
+  @parameters char *output, char *cmd_file, char *command, char *depfile, char **inputs, size_t num_inputs
+  @description PRIVATE FUNCTION | True if output exists, was built with the same command and none of its inputs (depfile entries and the extra inputs) changed
+  @returns bool
+*/
+static bool output_up_to_date(const char *output, const char *cmd_file, const char *command,
+                              const char *depfile, char **inputs, size_t num_inputs) {
+    if (access(output, F_OK) != 0) return false;
+
+    char *previous = read_file_contents(cmd_file, NULL);
+    if (!previous) return false;
+    bool same_command = strcmp(previous, command) == 0;
+    free(previous);
+    if (!same_command) {
+        verbose_log("Command for '%s' changed.\n", output);
+        return false;
+    }
+
+    size_t count;
+    char **deps = collect_inputs(depfile, inputs, num_inputs, &count);
+    if (!deps) return false;
+    bool up_to_date = dependencies_up_to_date(output, deps, count);
+    free_depfile(deps, count);
+    return up_to_date;
+}
+
+/*
+  @name output_built
+  @parameters char *output, char *depfile, char **inputs, size_t num_inputs
+  @description PRIVATE FUNCTION | Records the inputs of a freshly built output in content hash mode
+  @returns void
+*/
+static void output_built(const char *output, const char *depfile, char **inputs, size_t num_inputs) {
+    if (!content_hash_mode) return;
+    size_t count;
+    char **deps = collect_inputs(depfile, inputs, num_inputs, &count);
+    if (!deps) return;
+    record_build_hashes(output, deps, count);
+    free_depfile(deps, count);
+}
+
+/*
+  @name write_command_file
+  @parameters char *cmd_file, char *command
+  @description PRIVATE FUNCTION | Stores the command an output was built with
+  @returns void
+*/
+static void write_command_file(const char *cmd_file, const char *command) {
+    FILE *file = fopen(cmd_file, "w");
+    if (!file) {
+        fprintf(stderr, "Warning: Unable to write '%s'.\n", cmd_file);
+        return;
+    }
+    fputs(command, file);
+    fclose(file);
+}
+
+/*
+  @name create_parent_directories
+  @parameters char *path
+  @description PRIVATE FUNCTION | mkdir -p for every directory component of path (not the last one)
+  @returns int
+*/
+static int create_parent_directories(const char *path) {
+    char buffer[PATH_MAX];
+    snprintf(buffer, sizeof(buffer), "%s", path);
+    for (char *p = buffer + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(buffer, 0755) != 0 && errno != EEXIST) return S_ERROR;
+        *p = '/';
+    }
+    return 0;
+}
+
+/*
+  @name ensure_build_directory
   @parameters void
-  @description A simple interactive menu for Samba
+  @description PRIVATE FUNCTION | Creates build_directory if it does not exist
   @returns void
 */
-void interactive_menu() {
-    int choice;
-    do {
-        printf("\n--- Samba Menu ---\n");
-        printf("1. Add Library\n");
-        printf("2. Add Include Path\n");
-        printf("3. Set Build Directory\n");
-        printf("4. Compile\n");
-        printf("5. Exit\n");
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
+static void ensure_build_directory() {
+    if (build_directory == NULL || build_directory_exists(build_directory)) return;
+    if (verbose_mode) {
+        printf("Build directory '%s' does not exist. Creating it...\n", build_directory);
+    }
+    if (mkdir(build_directory, 0755) != 0 && errno != EEXIST) {
+        exit_error(__func__, "Failed to create build directory");
+    }
+    verbose_log("Build directory created successfully.\n");
+}
 
-        switch (choice) {
-            case 1:
-                {
-                    char lib[256];
-                    printf("Enter library name: ");
-                    scanf("%s", lib);
-                    define_library(lib);
-                }
-                break;
-            case 2:
-                {
-                    char path[256];
-                    printf("Enter include path: ");
-                    scanf("%s", path);
-                    define_include(path);
-                }
-                break;
-            case 3:
-                {
-                    char dir[256];
-                    printf("Enter build directory: ");
-                    scanf("%s", dir);
-                    set_build_directory(dir);
-                }
+// -- Precompiled Header --
+char *precompiled_header = NULL;
+
+typedef struct {
+    char include[PATH_MAX];     // what -include / -include-pch points at for one flag set
+    char output[PATH_MAX + 8];  // the .gch / .pch file itself
+} PrecompiledHeader;
+
+/*
+  @name define_precompiled_header
+  @parameters char *header
+  @description Precompiles header once per flag set into build_directory/pch and force-includes it in every translation unit
+  @returns int
+*/
+int define_precompiled_header(const char *header) {
+    precompiled_header = settings_string(header);
+    if (!precompiled_header) return S_ERROR;
+    return 0;
+}
+
+/*
+  @name uses_precompiled_header
+  @parameters char *option, char *argument
+  @description PRIVATE FUNCTION | True if option argument force-includes a header that only exists precompiled, e.g. -include build/pch/<hash>/all.h
+  @returns bool
+*/
+static bool uses_precompiled_header(const char *option, const char *argument) {
+    if (!precompiled_header) return false;
+    if (strcmp(option, "-include-pch") == 0) return true;
+    if (strcmp(option, "-include") != 0 || access(argument, F_OK) == 0) return false;
+    char gch[PATH_MAX + 8];
+    snprintf(gch, sizeof(gch), "%s.gch", argument);
+    return access(gch, F_OK) == 0;
+}
+
+// -- Unity Build --
+// INFO: compile_target concatenates sources into a few batch translation units (jumbo build)
+#ifdef S_UNITY_BUILD
+    bool unity_build = true;
+#else
+    bool unity_build = false;
+#endif
+
+#ifndef S_UNITY_BATCH_SIZE
+    #define S_UNITY_BATCH_SIZE 0 // 0 = sized from the job count and the build log
+#endif
+#ifndef S_UNITY_BATCH_SECONDS
+    #define S_UNITY_BATCH_SECONDS 10.0
+#endif
+#define S_UNITY_MAX_BATCH 64
+
+char **unity_excluded = NULL;
+size_t num_unity_excluded = 0;
+size_t unity_excluded_capacity = 0;
+
+/*
+  @name enable_unity_build
+  @parameters void
+  @description Enables unity builds for compile_target (same as defining S_UNITY_BUILD)
+  @returns void
+*/
+void enable_unity_build() {
+    unity_build = true;
+}
+
+/*
+  @name unity_exclude
+  @parameters char *source
+  @description Keeps source out of unity batches, e.g. because its statics or macros clash with other files
+  @returns int
+*/
+int unity_exclude(const char *source) {
+    if (settings_reserve((void **)&unity_excluded, num_unity_excluded, &unity_excluded_capacity, sizeof(char *)) != 0) return S_ERROR;
+    unity_excluded[num_unity_excluded] = settings_string(source);
+    if (!unity_excluded[num_unity_excluded]) return S_ERROR;
+    num_unity_excluded++;
+    return 0;
+}
+
+// -- Static Libraries --
+// INFO: compile_static_library archives with S_AR, members are stored by path so equal file names in different directories do not clash
+#ifndef S_AR
+    #define S_AR "ar"
+#endif
+#ifdef S_THIN_ARCHIVE
+    #define S_AR_MODE "rcsT" // members stay where they are, the archive only references them
+#else
+    #define S_AR_MODE "rcsP"
+#endif
+
+// -- Response Files --
+// INFO: Compiler commands longer than S_RESPONSE_FILE_BYTES pass their arguments as @<output>.rsp (gcc, clang and ld read these)
+#ifndef S_RESPONSE_FILE_BYTES
+    #define S_RESPONSE_FILE_BYTES 65536
+#endif
+
+/*
+  @name write_response_file
+  @parameters char *path, Command *command
+  @description PRIVATE FUNCTION | Writes every argument after the program, quoted for gcc's @file parser | an unchanged file is left alone
+  @returns int
+*/
+static int write_response_file(const char *path, const Command *command) {
+    size_t length = 1;
+    for (size_t i = 1; i < command->count; i++) length += strlen(command->items[i]) * 2 + 3;
+    char *contents = malloc(length);
+    if (!contents) return S_ERROR;
+
+    char *out = contents;
+    for (size_t i = 1; i < command->count; i++) {
+        const char *arg = command->items[i];
+        if (*arg == '\0') {
+            *out++ = '"';
+            *out++ = '"';
+        }
+        for (; *arg; arg++) {
+            if (isspace((unsigned char)*arg) || *arg == '\\' || *arg == '"' || *arg == '\'') *out++ = '\\';
+            *out++ = *arg;
+        }
+        *out++ = '\n';
+    }
+    *out = '\0';
+    length = (size_t)(out - contents);
+
+    size_t old_length;
+    char *old = read_file_contents(path, &old_length);
+    bool unchanged = old && old_length == length && memcmp(old, contents, length) == 0;
+    free(old);
+    if (unchanged) {
+        free(contents);
+        return 0;
+    }
+
+    char temp_path[PATH_MAX + 32];
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", path, (long)getpid());
+    FILE *file = fopen(temp_path, "w");
+    bool written = file && fwrite(contents, 1, length, file) == length;
+    if (file && fclose(file) != 0) written = false;
+    free(contents);
+    if (!written || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+        return S_ERROR;
+    }
+    return 0;
+}
+
+/*
+  @name run_compiler
+  @parameters Command *command, char *response_file, ProcessResult *result
+  @description Runs a compiler or linker command, through response_file when its arguments exceed S_RESPONSE_FILE_BYTES
+  @returns int | exit status of the process
+*/
+int run_compiler(const Command *command, const char *response_file, ProcessResult *result) {
+    size_t bytes = 0;
+    for (size_t i = 1; i < command->count; i++) bytes += strlen(command->items[i]) + 1;
+    if (bytes < S_RESPONSE_FILE_BYTES) return run_process(command, result);
+    if (write_response_file(response_file, command) != 0) {
+        fprintf(stderr, "Warning: Unable to write '%s', passing %zu bytes of arguments directly.\n", response_file, bytes);
+        return run_process(command, result);
+    }
+
+    verbose_log("Arguments of %s passed through %s\n", command->items[0], response_file);
+    Command spawned = {0};
+    command_push(&spawned, command->items[0]);
+    command_pushf(&spawned, "@%s", response_file);
+    int status = run_process(&spawned, result);
+    command_free(&spawned);
+    return status;
+}
+
+// -- Compilation Cache --
+// INFO: Content addressed object cache, key = preprocessed source + normalized flags + compiler identity
+#ifdef S_CACHE_COMPILATION
+    bool cache_compilation = true;
+#else
+    bool cache_compilation = false;
+#endif
+
+#ifndef S_CACHE_SIZE_MB
+    #define S_CACHE_SIZE_MB 2048
+#endif
+
+char *cache_directory = NULL;
+unsigned long long cache_size_limit = (unsigned long long)S_CACHE_SIZE_MB * 1024 * 1024;
+static unsigned long cache_hits = 0;
+static unsigned long cache_misses = 0;
+
+/*
+  @name enable_compilation_cache
+  @parameters void
+  @description Enables the object cache (same as defining S_CACHE_COMPILATION)
+  @returns void
+*/
+void enable_compilation_cache() {
+    cache_compilation = true;
+}
+
+/*
+  @name set_cache_directory
+  @parameters char *path
+  @description Sets where cached objects are stored (default $SAMBA_CACHE_DIR, $XDG_CACHE_HOME/samba or ~/.cache/samba)
+  @returns void
+*/
+void set_cache_directory(const char *path) {
+    free(cache_directory);
+    cache_directory = strdup(path);
+    if (!cache_directory) exit_error(__func__, "Failed to set cache directory");
+}
+
+/*
+  @name set_cache_size_limit
+  @parameters unsigned long long megabytes
+  @description Sets the size the cache is trimmed to, least recently used objects are evicted first
+  @returns void
+*/
+void set_cache_size_limit(unsigned long long megabytes) {
+    cache_size_limit = megabytes * 1024 * 1024;
+}
+
+/*
+  @name get_cache_directory
+  @parameters void
+  @description Returns the cache directory, resolving the default on first use
+  @returns char *
+*/
+const char *get_cache_directory() {
+    if (cache_directory) return cache_directory;
+
+    char path[PATH_MAX];
+    const char *env = getenv("SAMBA_CACHE_DIR");
+    if (env && *env) snprintf(path, sizeof(path), "%s", env);
+    else if ((env = getenv("XDG_CACHE_HOME")) && *env) snprintf(path, sizeof(path), "%s/samba", env);
+    else if ((env = getenv("HOME")) && *env) snprintf(path, sizeof(path), "%s/.cache/samba", env);
+    else snprintf(path, sizeof(path), "%s/.samba_cache", build_directory ? build_directory : ".");
+    set_cache_directory(path);
+    return cache_directory;
+}
+
+/*
+  @name copy_file_contents
+  @parameters char *from, char *to
+  @description PRIVATE FUNCTION | Copies a file through a temporary file and rename, so readers never see partial contents
+  @returns int
+*/
+static int copy_file_contents(const char *from, const char *to) {
+    int in = open(from, O_RDONLY);
+    if (in < 0) return S_ERROR;
+
+    char temp_path[PATH_MAX + 32];
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.%lx.tmp", to, (long)getpid(), (unsigned long)pthread_self());
+    int out = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        close(in);
+        return S_ERROR;
+    }
+
+    char buffer[65536];
+    ssize_t read_bytes;
+    int result = 0;
+    while ((read_bytes = read(in, buffer, sizeof(buffer))) > 0) {
+        char *p = buffer;
+        while (read_bytes > 0) {
+            ssize_t written = write(out, p, (size_t)read_bytes);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                result = S_ERROR;
                 break;
-            case 4:
-                {
-                    char src[256], out[256];
-                    printf("Enter source file: ");
-                    scanf("%s", src);
-                    printf("Enter output file: ");
-                    scanf("%s", out);
-                    compile(src, out, false);
+            }
+            p += written;
+            read_bytes -= written;
+        }
+        if (result != 0) break;
+    }
+    if (read_bytes < 0) result = S_ERROR;
+    close(in);
+    if (close(out) != 0) result = S_ERROR;
+
+    if (result == 0 && rename(temp_path, to) != 0) result = S_ERROR;
+    if (result != 0) unlink(temp_path);
+    return result;
+}
+
+/*
+  @name compiler_identity
+  @parameters char *compiler, uint64_t hash
+  @description PRIVATE FUNCTION | Mixes the resolved compiler binary (path, size, mtime) into hash
+  @returns uint64_t
+*/
+static uint64_t compiler_identity(const char *compiler, uint64_t hash) {
+    hash = hash_bytes(hash, compiler, strlen(compiler) + 1);
+
+    const char *path = getenv("PATH");
+    char candidate[PATH_MAX];
+    while (path && *path && !strchr(compiler, '/')) {
+        const char *end = strchr(path, ':');
+        size_t length = end ? (size_t)(end - path) : strlen(path);
+        snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)length, path, compiler);
+        struct stat st;
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode)) {
+            long long identity[2] = {(long long)st.st_size, (long long)st.st_mtim.tv_sec};
+            hash = hash_bytes(hash, candidate, strlen(candidate));
+            return hash_bytes(hash, identity, sizeof(identity));
+        }
+        if (!end) break;
+        path = end + 1;
+    }
+    struct stat st;
+    if (stat(compiler, &st) == 0) {
+        long long identity[2] = {(long long)st.st_size, (long long)st.st_mtim.tv_sec};
+        hash = hash_bytes(hash, identity, sizeof(identity));
+    }
+    return hash;
+}
+
+/*
+  @name cache_account
+  @parameters long long bytes
+  @description PRIVATE FUNCTION | Tracks the cache size in <cache>/stats and evicts least recently used objects over the limit
+  @returns void
+*/
+static void cache_account(long long bytes) {
+    char stats_path[PATH_MAX + 8];
+    snprintf(stats_path, sizeof(stats_path), "%s/stats", get_cache_directory());
+    int fd = open(stats_path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return;
+    flock(fd, LOCK_EX);
+
+    char buffer[64] = {0};
+    ssize_t length = pread(fd, buffer, sizeof(buffer) - 1, 0);
+    long long size = length > 0 ? atoll(buffer) : 0;
+    size += bytes;
+
+    if (size > 0 && (unsigned long long)size > cache_size_limit) {
+        typedef struct { char path[PATH_MAX + 272]; time_t used; long long size; } CachedObject;
+        CachedObject *objects = NULL;
+        size_t count = 0, capacity = 0;
+        size = 0;
+
+        DIR *root = opendir(get_cache_directory());
+        struct dirent *bucket;
+        while (root && (bucket = readdir(root)) != NULL) {
+            if (strlen(bucket->d_name) != 2) continue;
+            char bucket_path[PATH_MAX + 8];
+            snprintf(bucket_path, sizeof(bucket_path), "%s/%s", get_cache_directory(), bucket->d_name);
+            DIR *dir = opendir(bucket_path);
+            struct dirent *entry;
+            while (dir && (entry = readdir(dir)) != NULL) {
+                if (entry->d_name[0] == '.') continue;
+                if (count == capacity) {
+                    capacity = capacity ? capacity * 2 : 256;
+                    CachedObject *temp = realloc(objects, sizeof(CachedObject) * capacity);
+                    if (!temp) break;
+                    objects = temp;
                 }
-                break;
-            case 5:
-                printf("Exiting menu.\n");
-                break;
-            default:
-                printf("Invalid choice. Try again.\n");
+                CachedObject *object = &objects[count];
+                snprintf(object->path, sizeof(object->path), "%s/%s", bucket_path, entry->d_name);
+                struct stat st;
+                if (stat(object->path, &st) != 0) continue;
+                object->used = st.st_mtime;
+                object->size = st.st_size;
+                size += st.st_size;
+                count++;
+            }
+            if (dir) closedir(dir);
+        }
+        if (root) closedir(root);
+
+        // Oldest first, trim to 90% so we do not evict on every store
+        for (size_t i = 1; i < count; i++) {
+            CachedObject current = objects[i];
+            size_t j = i;
+            for (; j > 0 && objects[j - 1].used > current.used; j--) objects[j] = objects[j - 1];
+            objects[j] = current;
+        }
+        unsigned long long target = cache_size_limit / 10 * 9;
+        for (size_t i = 0; i < count && (unsigned long long)size > target; i++) {
+            if (unlink(objects[i].path) == 0) size -= objects[i].size;
+        }
+        verbose_log("Cache trimmed to %lld bytes.\n", size);
+        free(objects);
+    }
+
+    if (size < 0) size = 0;
+    int written = snprintf(buffer, sizeof(buffer), "%lld\n", size);
+    if (ftruncate(fd, 0) == 0 && pwrite(fd, buffer, (size_t)written, 0) < 0) {
+        verbose_log("Unable to update cache stats.\n");
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+/*
+  @name profile_key
+  @parameters char *arg, char *object, Command *key
+  @description PRIVATE FUNCTION | Keys the profile a -fprofile-use compile reads by its contents, so a retrained profile is a miss | -fprofile-generate objects embed the path of their .gcda and are never cached
+  @returns bool, false when the compile must bypass the cache
+*/
+static bool profile_key(const char *arg, const char *object, Command *key) {
+    if (strncmp(arg, "-fprofile-generate", 18) == 0 || strncmp(arg, "-fprofile-instr-generate", 24) == 0) return false;
+    char profile[PATH_MAX + 8];
+    if (strcmp(arg, "-fprofile-use") == 0) {
+        // gcc reads the .gcda named after the object
+        snprintf(profile, sizeof(profile), "%.*sgcda", (int)strlen(object) - 1, object);
+    } else if (strncmp(arg, "-fprofile-use=", 14) == 0 || strncmp(arg, "-fprofile-instr-use=", 20) == 0) {
+        snprintf(profile, sizeof(profile), "%s", strchr(arg, '=') + 1);
+    } else {
+        return true;
+    }
+
+    struct stat st;
+    if (stat(profile, &st) != 0) {
+        command_push(key, "profile:none");
+        return true;
+    }
+    // A profile directory holds .gcda files under mangled names
+    if (!S_ISREG(st.st_mode)) return false;
+    uint64_t hash[2];
+    if (hash_file_pair(profile, &hash[0], &hash[1]) != 0) return false;
+    command_pushf(key, "profile:%016llx%016llx", (unsigned long long)hash[0], (unsigned long long)hash[1]);
+    return true;
+}
+
+/*
+  @name cached_compile
+  @parameters Command *command, char *object, ProcessResult *result, bool *hit
+  @description PRIVATE FUNCTION | Runs a -c compile through the object cache, the depfile comes from the preprocessor run
+  @returns int
+*/
+static int cached_compile(const Command *command, const char *object, ProcessResult *result, bool *hit) {
+    *hit = false;
+    // The preprocessor command is the compile command with -c replaced by -E and -o pointing at a scratch file
+    char preprocessed[PATH_MAX + 8];
+    snprintf(preprocessed, sizeof(preprocessed), "%s.i", object);
+    char response_file[PATH_MAX + 8], preprocess_response_file[PATH_MAX + 16];
+    snprintf(response_file, sizeof(response_file), "%s.rsp", object);
+    snprintf(preprocess_response_file, sizeof(preprocess_response_file), "%s.i.rsp", object);
+    Command preprocess = {0};
+    Command key = {0}; // everything besides the preprocessed text the object depends on, also kept next to the entry
+    command_pushf(&key, "%016llx", (unsigned long long)compiler_identity(command->items[0], S_HASH_SEED));
+    bool cacheable = true;
+    for (size_t i = 0; i < command->count; i++) {
+        const char *arg = command->items[i];
+        if (i > 0 && !profile_key(arg, object, &key)) cacheable = false;
+        if (strcmp(arg, "-c") == 0) {
+            command_push(&preprocess, "-E");
+            continue;
+        }
+        if (strcmp(arg, "-o") == 0 && i + 1 < command->count) {
+            command_push(&preprocess, "-o");
+            command_push(&preprocess, preprocessed);
+            i++;
+            continue;
+        }
+        // The preprocessor cannot read a precompiled header, give it the real one
+        if (i + 1 < command->count && uses_precompiled_header(arg, command->items[i + 1])) {
+            command_push(&preprocess, "-include");
+            command_push(&preprocess, precompiled_header);
+            command_push(&key, "pch");
+            i++;
+            continue;
+        }
+        command_push(&preprocess, arg);
+        if (strcmp(arg, "-MF") == 0 && i + 1 < command->count) {
+            command_push(&preprocess, command->items[++i]);
+            command_push(&preprocess, "-MT");
+            command_push(&preprocess, object);
+            continue;
+        }
+        // Paths of the source and outputs are covered by the preprocessed text, flags are keyed here
+        if (i > 0 && i + 1 < command->count) command_push(&key, arg);
+    }
+    if (!cacheable) {
+        verbose_log("Not cached (instrumented or profile directory): %s\n", object);
+        command_free(&preprocess);
+        command_free(&key);
+        return run_compiler(command, response_file, result);
+    }
+
+    int status = run_compiler(&preprocess, preprocess_response_file, NULL);
+    command_free(&preprocess);
+    uint64_t source_hash[2];
+    int hashed = status == 0 ? hash_file_pair(preprocessed, &source_hash[0], &source_hash[1]) : S_ERROR;
+    unlink(preprocessed);
+    if (hashed != 0) {
+        command_free(&key);
+        return run_compiler(command, response_file, result);
+    }
+    command_pushf(&key, "%016llx%016llx", (unsigned long long)source_hash[0], (unsigned long long)source_hash[1]);
+    char *key_text = command_render(&key);
+    command_free(&key);
+
+    // Two independent 64 bit hashes name the entry, the key file next to it rules out what is left of a collision
+    size_t key_length = strlen(key_text);
+    uint64_t key_a = hash_bytes(S_HASH_SEED, key_text, key_length);
+    uint64_t key_b = hash_bytes_mix(S_HASH_MIX_SEED, key_text, key_length);
+    char entry[PATH_MAX + 64], entry_key[PATH_MAX + 72];
+    snprintf(entry, sizeof(entry), "%s/%02x/%016llx%016llx.o", get_cache_directory(), (unsigned)(key_a >> 56),
+             (unsigned long long)key_a, (unsigned long long)key_b);
+    snprintf(entry_key, sizeof(entry_key), "%s.key", entry);
+
+    size_t stored_length = 0;
+    char *stored_key = read_file_contents(entry_key, &stored_length);
+    bool verified = stored_key && stored_length == key_length && memcmp(stored_key, key_text, key_length) == 0;
+    if (stored_key && !verified) verbose_log("Cache entry %s belongs to another key, recompiling.\n", entry);
+    free(stored_key);
+    if (verified && copy_file_contents(entry, object) == 0) {
+        utimensat(AT_FDCWD, entry, NULL, 0);
+        __atomic_fetch_add(&cache_hits, 1, __ATOMIC_RELAXED);
+        verbose_log("Cache hit: %s\n", object);
+        *hit = true;
+        free(key_text);
+        return 0;
+    }
+
+    __atomic_fetch_add(&cache_misses, 1, __ATOMIC_RELAXED);
+    status = run_compiler(command, response_file, result);
+    if (status == 0 && create_parent_directories(entry) == 0 && copy_file_contents(object, entry) == 0 &&
+        write_file_atomically(entry_key, key_text, key_length) == 0) {
+        struct stat st;
+        if (stat(entry, &st) == 0) cache_account(st.st_size + (long long)key_length);
+    }
+    free(key_text);
+    return status;
+}
+
+/*
+  @name print_cache_statistics
+  @parameters void
+  @description Prints hits and misses of the object cache for this build
+  @returns void
+*/
+void print_cache_statistics() {
+    unsigned long hits = __atomic_load_n(&cache_hits, __ATOMIC_RELAXED);
+    unsigned long misses = __atomic_load_n(&cache_misses, __ATOMIC_RELAXED);
+    if (!cache_compilation || hits + misses == 0) return;
+    printf("Cache: %lu hits, %lu misses (%.1f%% hit rate)\n", hits, misses, 100.0 * (double)hits / (double)(hits + misses));
+}
+
+// -- Compilation Database --
+// INFO: build_directory/compile_commands.json for clangd and clang-tidy, the file is only rewritten when an entry changed
+#ifdef S_COMPILE_COMMANDS
+    bool compile_commands = true;
+#else
+    bool compile_commands = false;
+#endif
+
+typedef struct {
+    char *key;   // "<file>\t<output>"
+    char *entry; // the JSON object, one line
+    bool dirty;
+} CompileCommand;
+
+static CompileCommand *compile_command_records = NULL;
+static size_t num_compile_commands = 0;
+static size_t compile_commands_capacity = 0;
+static StringMap compile_command_index = {0};
+static char *compile_commands_path = NULL;
+static pthread_mutex_t compile_commands_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+  @name enable_compile_commands
+  @parameters void
+  @description Writes compile_commands.json into the build directory (same as defining S_COMPILE_COMMANDS)
+  @returns void
+*/
+void enable_compile_commands() {
+    compile_commands = true;
+}
+
+/*
+  @name compile_command_put
+  @parameters char *key, char *entry, bool dirty
+  @description PRIVATE FUNCTION | Inserts or replaces an entry, keeps the old one if it is identical | compile_commands_mutex must be held
+  @returns void
+*/
+static void compile_command_put(const char *key, const char *entry, bool dirty) {
+    size_t index;
+    if (string_map_get(&compile_command_index, key, &index)) {
+        CompileCommand *record = &compile_command_records[index];
+        if (strcmp(record->entry, entry) == 0) return;
+        char *copy = strdup(entry);
+        if (!copy) return;
+        free(record->entry);
+        record->entry = copy;
+        record->dirty = dirty;
+        return;
+    }
+
+    if (num_compile_commands == compile_commands_capacity) {
+        size_t new_capacity = compile_commands_capacity ? compile_commands_capacity * 2 : 64;
+        CompileCommand *temp = realloc(compile_command_records, sizeof(CompileCommand) * new_capacity);
+        if (!temp) return;
+        compile_command_records = temp;
+        compile_commands_capacity = new_capacity;
+    }
+    CompileCommand *record = &compile_command_records[num_compile_commands];
+    record->key = strdup(key);
+    record->entry = strdup(entry);
+    record->dirty = dirty;
+    if (!record->key || !record->entry || string_map_put(&compile_command_index, key, num_compile_commands) != 0) {
+        free(record->key);
+        free(record->entry);
+        return;
+    }
+    num_compile_commands++;
+}
+
+/*
+  @name json_read_field
+  @parameters char *line, char *name, FILE *out
+  @description PRIVATE FUNCTION | Copies the unescaped string value of "name" in a one line JSON object to out
+  @returns bool
+*/
+static bool json_read_field(const char *line, const char *name, FILE *out) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\": \"", name);
+    const char *c = strstr(line, pattern);
+    if (!c) return false;
+    for (c += strlen(pattern); *c && *c != '"'; c++) {
+        if (*c != '\\') {
+            fputc(*c, out);
+        } else if (c[1] == 'u' && c[2] && c[3] && c[4] && c[5]) {
+            fputc((int)strtol((char[]){c[2], c[3], c[4], c[5], '\0'}, NULL, 16), out);
+            c += 5;
+        } else if (c[1]) {
+            fputc(*++c, out);
+        }
+    }
+    return *c == '"';
+}
+
+/*
+  @name compile_commands_load
+  @parameters char *path
+  @description PRIVATE FUNCTION | Reads a compile_commands.json written by samba, entries changed by this process win | compile_commands_mutex must be held
+  @returns void
+*/
+static void compile_commands_load(const char *path) {
+    size_t length;
+    char *contents = read_file_contents(path, &length);
+    if (!contents) return;
+    char *save = NULL;
+    for (char *line = strtok_r(contents, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        while (*line == ' ') line++;
+        if (*line != '{') continue;
+        size_t line_length = strlen(line);
+        if (line[line_length - 1] == ',') line[--line_length] = '\0';
+
+        char *key = NULL;
+        size_t key_length = 0;
+        FILE *out = open_memstream(&key, &key_length);
+        if (!out) break;
+        bool valid = json_read_field(line, "file", out);
+        fputc('\t', out);
+        valid = json_read_field(line, "output", out) && valid;
+        fclose(out);
+
+        size_t index;
+        if (valid && !(string_map_get(&compile_command_index, key, &index) && compile_command_records[index].dirty)) {
+            compile_command_put(key, line, false);
+        }
+        free(key);
+    }
+    free(contents);
+}
+
+/*
+  @name save_compile_commands
+  @parameters void
+  @description Merges the entries of this run into build_directory/compile_commands.json (called automatically at exit)
+  @returns void
+*/
+void save_compile_commands() {
+    pthread_mutex_lock(&compile_commands_mutex);
+    bool dirty = false;
+    for (size_t i = 0; i < num_compile_commands; i++) dirty |= compile_command_records[i].dirty;
+
+    if (compile_commands_path && dirty) {
+        char lock_path[PATH_MAX + 8], temp_path[PATH_MAX + 32];
+        snprintf(lock_path, sizeof(lock_path), "%s.lock", compile_commands_path);
+        snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", compile_commands_path, (long)getpid());
+        int lock = open(lock_path, O_RDWR | O_CREAT, 0644);
+        if (lock >= 0) flock(lock, LOCK_EX);
+
+        compile_commands_load(compile_commands_path);
+        FILE *file = fopen(temp_path, "w");
+        if (file) {
+            fprintf(file, "[\n");
+            for (size_t i = 0; i < num_compile_commands; i++) {
+                fprintf(file, "  %s%s\n", compile_command_records[i].entry, i + 1 < num_compile_commands ? "," : "");
+            }
+            fprintf(file, "]\n");
+            if (fclose(file) == 0 && rename(temp_path, compile_commands_path) == 0) {
+                for (size_t i = 0; i < num_compile_commands; i++) compile_command_records[i].dirty = false;
+            } else {
+                unlink(temp_path);
+            }
+        }
+        if (lock >= 0) {
+            flock(lock, LOCK_UN);
+            close(lock);
+        }
+    }
+    pthread_mutex_unlock(&compile_commands_mutex);
+}
+
+/*
+  @name compile_commands_open
+  @parameters void
+  @description PRIVATE FUNCTION | Loads the compile_commands.json of the current build_directory | compile_commands_mutex must be held
+  @returns void
+*/
+static void compile_commands_open() {
+    static bool registered = false;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/compile_commands.json", build_directory ? build_directory : ".");
+    if (compile_commands_path && strcmp(compile_commands_path, path) == 0) return;
+
+    if (compile_commands_path) {
+        pthread_mutex_unlock(&compile_commands_mutex);
+        save_compile_commands();
+        pthread_mutex_lock(&compile_commands_mutex);
+        for (size_t i = 0; i < num_compile_commands; i++) {
+            free(compile_command_records[i].key);
+            free(compile_command_records[i].entry);
+        }
+        num_compile_commands = 0;
+        string_map_free(&compile_command_index);
+        free(compile_commands_path);
+    }
+    compile_commands_path = strdup(path);
+    if (!registered) {
+        atexit(save_compile_commands);
+        registered = true;
+    }
+    compile_commands_load(path);
+}
+
+/*
+  @name record_compile_command
+  @parameters char *file, char *output, Command *command
+  @description Adds or updates the entry of file in compile_commands.json if it is enabled, a precompiled header is listed as the header it came from
+  @returns void
+*/
+void record_compile_command(const char *file, const char *output, const Command *command) {
+    if (!compile_commands) return;
+    char directory[PATH_MAX];
+    if (!getcwd(directory, sizeof(directory))) return;
+
+    char *entry = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&entry, &length);
+    if (!out) return;
+    fprintf(out, "{\"directory\": ");
+    trace_write_string(out, directory);
+    fprintf(out, ", \"file\": ");
+    trace_write_string(out, file);
+    fprintf(out, ", \"output\": ");
+    trace_write_string(out, output);
+    fprintf(out, ", \"arguments\": [");
+    for (size_t i = 0; i < command->count; i++) {
+        const char *argument = command->items[i];
+        if (i + 1 < command->count && uses_precompiled_header(argument, command->items[i + 1])) {
+            fprintf(out, "%s\"-include\", ", i ? ", " : "");
+            trace_write_string(out, precompiled_header);
+            i++;
+            continue;
+        }
+        if (i) fprintf(out, ", ");
+        trace_write_string(out, argument);
+    }
+    fprintf(out, "]}");
+    fclose(out);
+
+    char *key = NULL;
+    size_t key_length = 0;
+    out = open_memstream(&key, &key_length);
+    if (out) {
+        fprintf(out, "%s\t%s", file, output);
+        fclose(out);
+        pthread_mutex_lock(&compile_commands_mutex);
+        compile_commands_open();
+        compile_command_put(key, entry, true);
+        pthread_mutex_unlock(&compile_commands_mutex);
+    }
+    free(key);
+    free(entry);
+}
+
+// -- Build Log --
+// INFO: Wall time of every command samba ran, per output, kept in build_directory/.samba_log
+typedef struct {
+    char *output;
+    double seconds;
+    bool dirty;
+} DurationRecord;
+
+static DurationRecord *duration_records = NULL;
+static size_t num_duration_records = 0;
+static size_t duration_records_capacity = 0;
+static StringMap duration_index = {0};
+static char *duration_log_path = NULL;
+static pthread_mutex_t duration_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#ifndef S_ESTIMATE_BYTES_PER_SECOND
+    #define S_ESTIMATE_BYTES_PER_SECOND 20000.0 // compile speed assumed for sources without history
+#endif
+
+/*
+  @name duration_put
+  @parameters char *output, double seconds, bool dirty
+  @description PRIVATE FUNCTION | Inserts or updates a duration | duration_mutex must be held
+  @returns void
+*/
+static void duration_put(const char *output, double seconds, bool dirty) {
+    size_t index;
+    if (!string_map_get(&duration_index, output, &index)) {
+        if (num_duration_records == duration_records_capacity) {
+            size_t new_capacity = duration_records_capacity ? duration_records_capacity * 2 : 128;
+            DurationRecord *temp = realloc(duration_records, sizeof(DurationRecord) * new_capacity);
+            if (!temp) return;
+            duration_records = temp;
+            duration_records_capacity = new_capacity;
+        }
+        index = num_duration_records;
+        duration_records[index].output = strdup(output);
+        if (!duration_records[index].output || string_map_put(&duration_index, output, index) != 0) return;
+        num_duration_records++;
+    }
+    duration_records[index].seconds = seconds;
+    duration_records[index].dirty = dirty;
+}
+
+/*
+  @name duration_log_load
+  @parameters char *path
+  @description PRIVATE FUNCTION | Reads a build log, records we changed in this run win
+  @returns void
+*/
+static void duration_log_load(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) return;
+    char line[PATH_MAX + 64];
+    if (fgets(line, sizeof(line), file) && strcmp(line, "samba-log 1\n") == 0) {
+        while (fgets(line, sizeof(line), file)) {
+            char *tab = strchr(line, '\t');
+            char *newline = strchr(line, '\n');
+            if (!tab || !newline) continue;
+            *newline = '\0';
+            size_t index;
+            if (string_map_get(&duration_index, tab + 1, &index) && duration_records[index].dirty) continue;
+            duration_put(tab + 1, atof(line), false);
+        }
+    }
+    fclose(file);
+}
+
+/*
+  @name save_build_log
+  @parameters void
+  @description Merges the durations of this run into build_directory/.samba_log (called automatically at exit)
+  @returns void
+*/
+void save_build_log() {
+    pthread_mutex_lock(&duration_mutex);
+    bool dirty = false;
+    for (size_t i = 0; i < num_duration_records; i++) dirty |= duration_records[i].dirty;
+
+    if (duration_log_path && dirty) {
+        char lock_path[PATH_MAX + 8], temp_path[PATH_MAX + 32];
+        snprintf(lock_path, sizeof(lock_path), "%s.lock", duration_log_path);
+        snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", duration_log_path, (long)getpid());
+        int lock = open(lock_path, O_RDWR | O_CREAT, 0644);
+        if (lock >= 0) flock(lock, LOCK_EX);
+
+        // Another samba process may have written since we loaded
+        duration_log_load(duration_log_path);
+        FILE *file = fopen(temp_path, "w");
+        if (file) {
+            fprintf(file, "samba-log 1\n");
+            for (size_t i = 0; i < num_duration_records; i++) {
+                fprintf(file, "%.3f\t%s\n", duration_records[i].seconds, duration_records[i].output);
+            }
+            if (fclose(file) == 0 && rename(temp_path, duration_log_path) == 0) {
+                for (size_t i = 0; i < num_duration_records; i++) duration_records[i].dirty = false;
+            } else {
+                unlink(temp_path);
+            }
+        }
+        if (lock >= 0) {
+            flock(lock, LOCK_UN);
+            close(lock);
+        }
+    }
+    pthread_mutex_unlock(&duration_mutex);
+}
+
+/*
+  @name duration_log_open
+  @parameters void
+  @description PRIVATE FUNCTION | Loads the build log of the current build_directory | duration_mutex must be held
+  @returns void
+*/
+static void duration_log_open() {
+    static bool registered = false;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/.samba_log", build_directory ? build_directory : ".");
+    if (duration_log_path && strcmp(duration_log_path, path) == 0) return;
+
+    if (duration_log_path) {
+        pthread_mutex_unlock(&duration_mutex);
+        save_build_log();
+        pthread_mutex_lock(&duration_mutex);
+        for (size_t i = 0; i < num_duration_records; i++) free(duration_records[i].output);
+        num_duration_records = 0;
+        string_map_free(&duration_index);
+        free(duration_log_path);
+    }
+    duration_log_path = strdup(path);
+    if (!registered) {
+        atexit(save_build_log);
+        registered = true;
+    }
+    duration_log_load(path);
+}
+
+/*
+  @name record_duration
+  @parameters char *output, double seconds
+  @description Stores how long building output took
+  @returns void
+*/
+void record_duration(const char *output, double seconds) {
+    pthread_mutex_lock(&duration_mutex);
+    duration_log_open();
+    duration_put(output, seconds, true);
+    pthread_mutex_unlock(&duration_mutex);
+}
+
+/*
+  @name get_recorded_duration
+  @parameters char *output
+  @description Returns how long building output took last time, or -1 if it was never built
+  @returns double
+*/
+double get_recorded_duration(const char *output) {
+    pthread_mutex_lock(&duration_mutex);
+    duration_log_open();
+    size_t index;
+    double seconds = string_map_get(&duration_index, output, &index) ? duration_records[index].seconds : -1;
+    pthread_mutex_unlock(&duration_mutex);
+    return seconds;
+}
+
+/*
+  @name estimate_duration
+  @parameters char *output, char **sources, size_t num_sources
+  @description Expected time to build output: its recorded duration, or a guess from the size of its sources when it was never built
+  @returns double
+*/
+double estimate_duration(const char *output, char **sources, size_t num_sources) {
+    double seconds = get_recorded_duration(output);
+    if (seconds >= 0) return seconds;
+
+    double bytes = 0;
+    for (size_t i = 0; i < num_sources; i++) {
+        struct stat st;
+        if (stat(sources[i], &st) == 0) bytes += (double)st.st_size;
+    }
+    return bytes / S_ESTIMATE_BYTES_PER_SECOND;
+}
+
+// -- Probe Cache --
+// INFO: pkg-config answers are kept in build_directory/.samba_probes and reused while the environment, pkg-config
+//       and the .pc files they came from are unchanged
+typedef struct {
+    char *key;        // "<pkg-config option> <package> <environment hash>"
+    char *output;     // full stdout, trailing newline removed
+    char *depends_on; // "<sec>.<nsec> <path>;..." the answer is valid while these mtimes hold
+    int status;
+    bool dirty;
+} ProbeRecord;
+
+static ProbeRecord *probe_records = NULL;
+static size_t num_probe_records = 0;
+static size_t probe_records_capacity = 0;
+static StringMap probe_index = {0};
+static char *probe_cache_path = NULL;
+static StringMap tool_probes = {0}; // "<PATH>\t<tool>" -> found + 1, PATH lookups are cheap enough to only keep in memory
+static pthread_mutex_t probe_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+  @name probe_put
+  @parameters char *key, int status, char *output, char *depends_on, bool dirty
+  @description PRIVATE FUNCTION | Inserts or replaces a probe answer | probe_mutex must be held
+  @returns void
+*/
+static void probe_put(const char *key, int status, const char *output, const char *depends_on, bool dirty) {
+    size_t index;
+    if (!string_map_get(&probe_index, key, &index)) {
+        if (num_probe_records == probe_records_capacity) {
+            size_t new_capacity = probe_records_capacity ? probe_records_capacity * 2 : 32;
+            ProbeRecord *temp = realloc(probe_records, sizeof(ProbeRecord) * new_capacity);
+            if (!temp) return;
+            probe_records = temp;
+            probe_records_capacity = new_capacity;
+        }
+        index = num_probe_records;
+        memset(&probe_records[index], 0, sizeof(ProbeRecord));
+        probe_records[index].key = strdup(key);
+        if (!probe_records[index].key || string_map_put(&probe_index, key, index) != 0) return;
+        num_probe_records++;
+    }
+    ProbeRecord *record = &probe_records[index];
+    free(record->output);
+    free(record->depends_on);
+    record->output = strdup(output);
+    record->depends_on = strdup(depends_on);
+    record->status = status;
+    record->dirty = dirty;
+}
+
+/*
+  @name probe_cache_load
+  @parameters char *path
+  @description PRIVATE FUNCTION | Reads a probe cache file, answers found by this process win | probe_mutex must be held
+  @returns void
+*/
+static void probe_cache_load(const char *path) {
+    size_t length;
+    char *contents = read_file_contents(path, &length);
+    if (!contents) return;
+    if (strncmp(contents, "samba-probes 1\n", 15) == 0) {
+        char *save = NULL;
+        for (char *line = strtok_r(contents + 15, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+            // key \t status \t depends_on \t output
+            char *fields[4] = {line, NULL, NULL, NULL};
+            for (int i = 1; i < 4; i++) {
+                fields[i] = strchr(fields[i - 1], '\t');
+                if (!fields[i]) break;
+                *fields[i]++ = '\0';
+            }
+            if (!fields[3]) continue;
+            size_t index;
+            if (string_map_get(&probe_index, fields[0], &index) && probe_records[index].dirty) continue;
+            probe_put(fields[0], atoi(fields[1]), fields[3], fields[2], false);
+        }
+    }
+    free(contents);
+}
+
+/*
+  @name save_probe_cache
+  @parameters void
+  @description Merges the probe answers of this run into build_directory/.samba_probes (called automatically at exit)
+  @returns void
+*/
+void save_probe_cache() {
+    pthread_mutex_lock(&probe_mutex);
+    bool dirty = false;
+    for (size_t i = 0; i < num_probe_records; i++) dirty |= probe_records[i].dirty;
+
+    if (probe_cache_path && dirty) {
+        char lock_path[PATH_MAX + 8], temp_path[PATH_MAX + 32];
+        snprintf(lock_path, sizeof(lock_path), "%s.lock", probe_cache_path);
+        snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", probe_cache_path, (long)getpid());
+        int lock = open(lock_path, O_RDWR | O_CREAT, 0644);
+        if (lock >= 0) flock(lock, LOCK_EX);
+
+        probe_cache_load(probe_cache_path);
+        FILE *file = fopen(temp_path, "w");
+        if (file) {
+            fprintf(file, "samba-probes 1\n");
+            for (size_t i = 0; i < num_probe_records; i++) {
+                ProbeRecord *r = &probe_records[i];
+                fprintf(file, "%s\t%d\t%s\t%s\n", r->key, r->status, r->depends_on, r->output);
+            }
+            if (fclose(file) == 0 && rename(temp_path, probe_cache_path) == 0) {
+                for (size_t i = 0; i < num_probe_records; i++) probe_records[i].dirty = false;
+            } else {
+                unlink(temp_path);
+            }
+        }
+        if (lock >= 0) {
+            flock(lock, LOCK_UN);
+            close(lock);
+        }
+    }
+    pthread_mutex_unlock(&probe_mutex);
+}
+
+/*
+  @name probe_cache_open
+  @parameters void
+  @description PRIVATE FUNCTION | Loads the probe cache of the current build_directory | probe_mutex must be held
+  @returns void
+*/
+static void probe_cache_open() {
+    static bool registered = false;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/.samba_probes", build_directory ? build_directory : ".");
+    if (probe_cache_path && strcmp(probe_cache_path, path) == 0) return;
+
+    if (probe_cache_path) {
+        pthread_mutex_unlock(&probe_mutex);
+        save_probe_cache();
+        pthread_mutex_lock(&probe_mutex);
+        for (size_t i = 0; i < num_probe_records; i++) {
+            free(probe_records[i].key);
+            free(probe_records[i].output);
+            free(probe_records[i].depends_on);
+        }
+        num_probe_records = 0;
+        string_map_free(&probe_index);
+        free(probe_cache_path);
+    }
+    probe_cache_path = strdup(path);
+    if (!registered) {
+        atexit(save_probe_cache);
+        registered = true;
+    }
+    probe_cache_load(path);
+}
+
+/*
+  @name probe_still_valid
+  @parameters char *depends_on
+  @description PRIVATE FUNCTION | True if every file in a depends_on list still has its recorded mtime
+  @returns bool
+*/
+static bool probe_still_valid(const char *depends_on) {
+    const char *entry = depends_on;
+    while (*entry) {
+        long long sec;
+        long nsec;
+        int offset = 0;
+        if (sscanf(entry, "%lld.%ld %n", &sec, &nsec, &offset) != 2) return false;
+        const char *path = entry + offset;
+        const char *end = strchr(path, ';');
+        size_t length = end ? (size_t)(end - path) : strlen(path);
+        char file[PATH_MAX];
+        if (length >= sizeof(file)) return false;
+        memcpy(file, path, length);
+        file[length] = '\0';
+
+        struct stat st;
+        if (stat(file, &st) != 0) {
+            if (sec != -1) return false;
+        } else if (st.st_mtim.tv_sec != sec || st.st_mtim.tv_nsec != nsec) {
+            return false;
+        }
+        if (!end) break;
+        entry = end + 1;
+    }
+    return true;
+}
+
+/*
+  @name probe_depend_on
+  @parameters FILE *out, char *path
+  @description PRIVATE FUNCTION | Appends path and its mtime (-1 if it does not exist) to a depends_on list
+  @returns void
+*/
+static void probe_depend_on(FILE *out, const char *path) {
+    struct stat st;
+    if (stat(path, &st) == 0) fprintf(out, "%lld.%ld %s;", (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec, path);
+    else fprintf(out, "-1.0 %s;", path);
+}
+
+/*
+  @name probe_pc_requires
+  @parameters char *pc_file, Command *packages
+  @description PRIVATE FUNCTION | Appends the packages named in Requires and Requires.private of a .pc file that are not in packages yet
+  @returns void
+*/
+static void probe_pc_requires(const char *pc_file, Command *packages) {
+    char *contents = read_file_contents(pc_file, NULL);
+    if (!contents) return;
+    char *save = NULL;
+    for (char *line = strtok_r(contents, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        while (isspace((unsigned char)*line)) line++;
+        char *value = strncmp(line, "Requires:", 9) == 0 ? line + 9
+                    : strncmp(line, "Requires.private:", 17) == 0 ? line + 17 : NULL;
+        if (!value) continue;
+        char *comment = strchr(value, '#');
+        if (comment) *comment = '\0';
+
+        // "a >= 1.0, b c" -> a b c
+        char *names_save = NULL;
+        bool skip_version = false;
+        for (char *name = strtok_r(value, " \t\r,", &names_save); name; name = strtok_r(NULL, " \t\r,", &names_save)) {
+            if (skip_version) {
+                skip_version = false;
+                continue;
+            }
+            if (strchr("<>=!", name[0])) {
+                skip_version = true;
+                continue;
+            }
+            bool known = false;
+            for (size_t i = 0; i < packages->count && !known; i++) known = strcmp(packages->items[i], name) == 0;
+            if (!known) command_push(packages, name);
+        }
+    }
+    free(contents);
+}
+
+/*
+  @name find_in_path
+  @parameters char *tool, char *buffer, size_t size
+  @description PRIVATE FUNCTION | Resolves tool through PATH into buffer
+  @returns bool
+*/
+static bool find_in_path(const char *tool, char *buffer, size_t size) {
+    if (strchr(tool, '/')) {
+        snprintf(buffer, size, "%s", tool);
+        return access(tool, X_OK) == 0;
+    }
+
+    const char *path = getenv("PATH");
+    if (!path) path = "/usr/local/bin:/usr/bin:/bin";
+    while (*path) {
+        const char *end = strchr(path, ':');
+        size_t length = end ? (size_t)(end - path) : strlen(path);
+        if (length == 0) snprintf(buffer, size, "./%s", tool);
+        else snprintf(buffer, size, "%.*s/%s", (int)length, path, tool);
+
+        struct stat st;
+        if (stat(buffer, &st) == 0 && S_ISREG(st.st_mode) && access(buffer, X_OK) == 0) return true;
+        if (!end) break;
+        path = end + 1;
+    }
+    return false;
+}
+
+/*
+  @name check_tool
+  @parameters char *tool
+  @description Checks if a tool is available in PATH, answers are remembered per PATH
+  @returns bool
+*/
+bool check_tool(const char *tool) {
+    const char *path = getenv("PATH");
+    size_t key_length = strlen(path ? path : "") + strlen(tool) + 2;
+    char *key = malloc(key_length);
+    if (!key) return false;
+    snprintf(key, key_length, "%s\t%s", path ? path : "", tool);
+
+    pthread_mutex_lock(&probe_mutex);
+    size_t known;
+    bool cached = string_map_get(&tool_probes, key, &known);
+    pthread_mutex_unlock(&probe_mutex);
+    if (cached) {
+        free(key);
+        return known == 2;
+    }
+
+    char resolved[PATH_MAX];
+    bool found = find_in_path(tool, resolved, sizeof(resolved));
+    pthread_mutex_lock(&probe_mutex);
+    string_map_put(&tool_probes, key, found ? 2 : 1);
+    pthread_mutex_unlock(&probe_mutex);
+    free(key);
+    return found;
+}
+
+static char *pkg_config_search_path();
+
+/*
+  @name pkg_config_probe
+  @parameters char *option, char *package, char **output
+  @description Runs "pkg-config <option> <package>" or answers from the probe cache, *output gets the full stdout (malloc'd)
+  @returns int
+*/
+int pkg_config_probe(const char *option, const char *package, char **output) {
+    *output = NULL;
+    char pkg_config[PATH_MAX];
+    if (!find_in_path("pkg-config", pkg_config, sizeof(pkg_config))) return S_ERROR;
+
+    const char *variables[] = {"PKG_CONFIG_PATH", "PKG_CONFIG_LIBDIR", "PKG_CONFIG_SYSROOT_DIR", "PATH"};
+    uint64_t environment = S_HASH_SEED;
+    for (size_t i = 0; i < sizeof(variables) / sizeof(variables[0]); i++) {
+        const char *value = getenv(variables[i]);
+        environment = hash_bytes(environment, value ? value : "", value ? strlen(value) + 1 : 0);
+        environment = hash_bytes(environment, "\n", 1);
+    }
+    char environment_key[32];
+    snprintf(environment_key, sizeof(environment_key), "%016llx", (unsigned long long)environment);
+
+    size_t key_length = strlen(option) + strlen(package) + sizeof(environment_key) + 3;
+    char *key = malloc(key_length);
+    if (!key) return S_ERROR;
+    snprintf(key, key_length, "%s %s %s", option, package, environment_key);
+
+    pthread_mutex_lock(&probe_mutex);
+    probe_cache_open();
+    size_t index;
+    if (string_map_get(&probe_index, key, &index) && probe_still_valid(probe_records[index].depends_on)) {
+        int status = probe_records[index].status;
+        *output = strdup(probe_records[index].output);
+        pthread_mutex_unlock(&probe_mutex);
+        verbose_log("Probe cached: pkg-config %s %s\n", option, package);
+        free(key);
+        return status;
+    }
+    pthread_mutex_unlock(&probe_mutex);
+
+    // Record the mtimes before running so a change while it runs invalidates the answer
+    char *depends_on = NULL;
+    size_t depends_length = 0;
+    FILE *out = open_memstream(&depends_on, &depends_length);
+    if (!out) {
+        free(key);
+        return S_ERROR;
+    }
+    probe_depend_on(out, pkg_config);
+    Command dirs = {0}, packages = {0};
+    char *search_path = strcmp(option, "--variable=pc_path") == 0 ? NULL : pkg_config_search_path();
+    for (char *save = NULL, *dir = search_path ? strtok_r(search_path, ":", &save) : NULL; dir; dir = strtok_r(NULL, ":", &save)) {
+        command_push(&dirs, dir);
+        probe_depend_on(out, dir); // a .pc file appearing in an earlier directory would shadow the one we found
+    }
+    free(search_path);
+    // The answer also depends on every .pc file pulled in through Requires and Requires.private
+    if (dirs.count > 0) command_push(&packages, package);
+    for (size_t p = 0; p < packages.count; p++) {
+        bool found = false;
+        for (size_t i = 0; i < dirs.count; i++) {
+            char pc_file[PATH_MAX];
+            snprintf(pc_file, sizeof(pc_file), "%s/%s.pc", dirs.items[i], packages.items[p]);
+            probe_depend_on(out, pc_file);
+            if (!found && access(pc_file, R_OK) == 0) {
+                found = true;
+                probe_pc_requires(pc_file, &packages);
+            }
+        }
+    }
+    command_free(&dirs);
+    command_free(&packages);
+    fclose(out);
+
+    Command command = {0};
+    command_push(&command, pkg_config);
+    command_push(&command, option);
+    command_push(&command, package);
+    char *captured = NULL;
+    int status = run_process_capture(&command, &captured);
+    command_free(&command);
+    if (!captured) captured = strdup("");
+
+    // Cached answers are single lines
+    for (char *c = captured; c && *c; c++) {
+        if (*c == '\n' || *c == '\t') *c = ' ';
+    }
+    size_t length = captured ? strlen(captured) : 0;
+    while (length > 0 && captured[length - 1] == ' ') captured[--length] = '\0';
+
+    if (captured && status >= 0) {
+        pthread_mutex_lock(&probe_mutex);
+        probe_put(key, status, captured, depends_on, true);
+        pthread_mutex_unlock(&probe_mutex);
+    }
+    free(depends_on);
+    free(key);
+    *output = captured;
+    return status;
+}
+
+// Only used when pkg-config is not installed and so cannot tell its built-in path
+#if defined(__x86_64__) && defined(__linux__)
+    #define S_PC_MULTIARCH_PATH "/usr/local/lib/x86_64-linux-gnu/pkgconfig:/usr/lib/x86_64-linux-gnu/pkgconfig:"
+#elif defined(__aarch64__) && defined(__linux__)
+    #define S_PC_MULTIARCH_PATH "/usr/local/lib/aarch64-linux-gnu/pkgconfig:/usr/lib/aarch64-linux-gnu/pkgconfig:"
+#else
+    #define S_PC_MULTIARCH_PATH ""
+#endif
+#define S_PC_FALLBACK_PATH S_PC_MULTIARCH_PATH "/usr/local/lib/pkgconfig:/usr/local/share/pkgconfig:/usr/lib64/pkgconfig:" \
+                           "/usr/lib/pkgconfig:/usr/share/pkgconfig:/opt/homebrew/lib/pkgconfig"
+
+/*
+  @name pkg_config_search_path
+  @parameters void
+  @description PRIVATE FUNCTION | Directories pkg-config looks in, PKG_CONFIG_PATH first, then PKG_CONFIG_LIBDIR or its built-in path (pc_path, the answer is in the probe cache) | the probe cache and the .pc reader both search this path
+  @returns char *
+*/
+static char *pkg_config_search_path() {
+    const char *user_path = getenv("PKG_CONFIG_PATH");
+    const char *libdir = getenv("PKG_CONFIG_LIBDIR");
+    char *builtin = NULL;
+    if (!libdir) {
+        if (pkg_config_probe("--variable=pc_path", "pkg-config", &builtin) != 0) {
+            free(builtin);
+            builtin = NULL;
+        }
+        libdir = builtin ? builtin : S_PC_FALLBACK_PATH;
+    }
+
+    size_t length = strlen(user_path ? user_path : "") + strlen(libdir) + 2;
+    char *search_path = malloc(length);
+    if (search_path) snprintf(search_path, length, "%s:%s", user_path ? user_path : "", libdir);
+    free(builtin);
+    return search_path;
+}
+
+// -- Package Resolution --
+// INFO: Reads pkg-config .pc files directly, pkg-config itself is only asked when a package is not found here
+typedef struct {
+    Command names;  // variable names, values[i] belongs to names.items[i]
+    Command values; // already expanded
+    char *cflags;
+    char *libs;
+    char *requires;
+    char *requires_private;
+} PcFile;
+
+/*
+  @name pc_search_path
+  @parameters Command *dirs
+  @description PRIVATE FUNCTION | pkg_config_search_path split into directories, so a package resolves to the same .pc file pkg-config would pick
+  @returns void
+*/
+static void pc_search_path(Command *dirs) {
+    char *search_path = pkg_config_search_path();
+    char *save = NULL;
+    for (char *dir = search_path ? strtok_r(search_path, ":", &save) : NULL; dir; dir = strtok_r(NULL, ":", &save)) {
+        command_push(dirs, dir);
+    }
+    free(search_path);
+}
+
+/*
+  @name pc_expand
+  @parameters PcFile *pc, char *value
+  @description PRIVATE FUNCTION | Replaces ${name} with the variables defined so far (pkg-config also only sees earlier ones)
+  @returns char *
+*/
+static char *pc_expand(const PcFile *pc, const char *value) {
+    char *result = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&result, &length);
+    if (!out) return NULL;
+    for (const char *c = value; *c; c++) {
+        if (c[0] == '$' && c[1] == '$') {
+            fputc('$', out);
+            c++;
+            continue;
+        }
+        const char *end = (c[0] == '$' && c[1] == '{') ? strchr(c + 2, '}') : NULL;
+        if (!end) {
+            fputc(*c, out);
+            continue;
+        }
+        size_t name_length = (size_t)(end - c - 2);
+        for (size_t i = pc->names.count; i-- > 0;) {
+            if (strlen(pc->names.items[i]) == name_length && strncmp(pc->names.items[i], c + 2, name_length) == 0) {
+                fputs(pc->values.items[i], out);
+                break;
+            }
+        }
+        c = end;
+    }
+    fclose(out);
+    return result;
+}
+
+/*
+  @name pc_free
+  @parameters PcFile *pc
+  @description PRIVATE FUNCTION | Frees a parsed .pc file
+  @returns void
+*/
+static void pc_free(PcFile *pc) {
+    command_free(&pc->names);
+    command_free(&pc->values);
+    free(pc->cflags);
+    free(pc->libs);
+    free(pc->requires);
+    free(pc->requires_private);
+    memset(pc, 0, sizeof(*pc));
+}
+
+/*
+  @name pc_load
+  @parameters char *package, PcFile *pc
+  @description PRIVATE FUNCTION | Finds package.pc on the search path and parses its variables and the fields samba needs
+  @returns int
+*/
+static int pc_load(const char *package, PcFile *pc) {
+    memset(pc, 0, sizeof(*pc));
+    Command dirs = {0};
+    pc_search_path(&dirs);
+    char path[PATH_MAX];
+    bool found = false;
+    for (size_t i = 0; i < dirs.count && !found; i++) {
+        snprintf(path, sizeof(path), "%s/%s.pc", dirs.items[i], package);
+        found = access(path, R_OK) == 0;
+    }
+    command_free(&dirs);
+    if (!found) return S_ERROR;
+
+    size_t length;
+    char *contents = read_file_contents(path, &length);
+    if (!contents) return S_ERROR;
+
+    char *directory = strdup(path);
+    if (directory) *strrchr(directory, '/') = '\0';
+    const char *sysroot = getenv("PKG_CONFIG_SYSROOT_DIR");
+    command_push(&pc->names, "pcfiledir");
+    command_push(&pc->values, directory ? directory : ".");
+    command_push(&pc->names, "pc_sysrootdir");
+    command_push(&pc->values, sysroot ? sysroot : "/");
+    free(directory);
+
+    char *save = NULL;
+    for (char *line = strtok_r(contents, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        while (isspace((unsigned char)*line)) line++;
+
+        // "name=value" defines a variable, "Field: value" a field, whichever separator comes first
+        char *separator = line + strcspn(line, "=:");
+        if (*separator == '\0' || separator == line) continue;
+        char kind = *separator;
+        char *name_end = separator;
+        while (name_end > line && isspace((unsigned char)name_end[-1])) name_end--;
+        *name_end = '\0';
+        char *value = separator + 1;
+        while (isspace((unsigned char)*value)) value++;
+        char *value_end = value + strlen(value);
+        while (value_end > value && isspace((unsigned char)value_end[-1])) *--value_end = '\0';
+
+        char *expanded = pc_expand(pc, value);
+        if (!expanded) continue;
+        if (kind == '=') {
+            command_push(&pc->names, line);
+            command_push(&pc->values, expanded);
+            free(expanded);
+            continue;
+        }
+        char **field = strcmp(line, "Cflags") == 0 || strcmp(line, "CFlags") == 0 ? &pc->cflags
+                     : strcmp(line, "Libs") == 0 ? &pc->libs
+                     : strcmp(line, "Requires") == 0 ? &pc->requires
+                     : strcmp(line, "Requires.private") == 0 ? &pc->requires_private : NULL;
+        if (field) {
+            free(*field);
+            *field = expanded;
+        } else {
+            free(expanded);
+        }
+    }
+    free(contents);
+    return 0;
+}
+
+/*
+  @name pc_collect
+  @parameters char *package, bool libs, Command *visited, Command *fields
+  @description PRIVATE FUNCTION | Depth first walk over Requires (and Requires.private for Cflags), fields gets the Cflags or Libs of every package in post order
+  @returns int
+*/
+static int pc_collect(const char *package, bool libs, Command *visited, Command *fields) {
+    for (size_t i = 0; i < visited->count; i++) {
+        if (strcmp(visited->items[i], package) == 0) return 0;
+    }
+    command_push(visited, package);
+
+    PcFile pc;
+    if (pc_load(package, &pc) != 0) {
+        verbose_log("Package '%s' has no .pc file on the search path\n", package);
+        return S_ERROR;
+    }
+
+    // "a >= 1.0, b c" -> a b c, versions are not checked
+    char *requires[] = {pc.requires, libs ? NULL : pc.requires_private};
+    int result = 0;
+    for (int r = 0; r < 2 && result == 0; r++) {
+        if (!requires[r]) continue;
+        char *save = NULL;
+        bool skip_version = false;
+        for (char *name = strtok_r(requires[r], " \t,", &save); name && result == 0; name = strtok_r(NULL, " \t,", &save)) {
+            if (skip_version) {
+                skip_version = false;
+            } else if (strchr("<>=!", name[0])) {
+                skip_version = true;
+            } else {
+                result = pc_collect(name, libs, visited, fields);
+            }
+        }
+    }
+    command_push(fields, (libs ? pc.libs : pc.cflags) ? (libs ? pc.libs : pc.cflags) : "");
+    pc_free(&pc);
+    return result;
+}
+
+/*
+  @name pc_is_system_directory
+  @parameters char *flag
+  @description PRIVATE FUNCTION | True for -I/-L of a directory the compiler searches anyway, pkg-config leaves those out too
+  @returns bool
+*/
+static bool pc_is_system_directory(const char *flag) {
+    bool include = strncmp(flag, "-I", 2) == 0;
+    if (!include && strncmp(flag, "-L", 2) != 0) return false;
+    if (getenv(include ? "PKG_CONFIG_ALLOW_SYSTEM_CFLAGS" : "PKG_CONFIG_ALLOW_SYSTEM_LIBS")) return false;
+
+    const char *list = getenv(include ? "PKG_CONFIG_SYSTEM_INCLUDE_PATH" : "PKG_CONFIG_SYSTEM_LIBRARY_PATH");
+    if (!list) {
+        list = include ? "/usr/include"
+                       : "/usr/lib:/lib:/usr/lib64:/lib64:/usr/lib/x86_64-linux-gnu:/lib/x86_64-linux-gnu:"
+                         "/usr/lib/aarch64-linux-gnu:/lib/aarch64-linux-gnu";
+    }
+    const char *dir = flag + 2;
+    size_t length = strlen(dir);
+    while (length > 1 && dir[length - 1] == '/') length--;
+    for (const char *entry = list; *entry;) {
+        const char *end = strchr(entry, ':');
+        size_t entry_length = end ? (size_t)(end - entry) : strlen(entry);
+        if (entry_length == length && strncmp(entry, dir, length) == 0) return true;
+        if (!end) break;
+        entry = end + 1;
+    }
+    return false;
+}
+
+/*
+  @name resolve_package
+  @parameters char *package, bool libs, Command *out
+  @description Resolves the Cflags or Libs of a package from its .pc files without running pkg-config, duplicates are removed (the first -I/-L wins, otherwise the last so libraries stay after their users)
+  @returns int
+*/
+int resolve_package(const char *package, bool libs, Command *out) {
+    Command visited = {0}, fields = {0}, all = {0};
+    int result = pc_collect(package, libs, &visited, &fields);
+    command_free(&visited);
+    // Reversed post order puts every package before the ones it requires
+    for (size_t i = fields.count; i-- > 0;) command_push_split(&all, fields.items[i]);
+    command_free(&fields);
+    if (result != 0) {
+        command_free(&all);
+        return S_ERROR;
+    }
+
+    const char *sysroot = getenv("PKG_CONFIG_SYSROOT_DIR");
+    for (size_t i = 0; i < all.count; i++) {
+        const char *token = all.items[i];
+        bool keep_last = strncmp(token, "-I", 2) != 0 && strncmp(token, "-L", 2) != 0;
+        bool duplicate = false;
+        for (size_t j = keep_last ? i + 1 : 0; j < (keep_last ? all.count : i) && !duplicate; j++) {
+            duplicate = strcmp(all.items[j], token) == 0;
+        }
+        if (duplicate || pc_is_system_directory(token)) continue;
+
+        if (sysroot && *sysroot && (strncmp(token, "-I/", 3) == 0 || strncmp(token, "-L/", 3) == 0)) {
+            command_pushf(out, "%.2s%s%s", token, sysroot, token + 2);
+        } else {
+            command_push(out, token);
+        }
+    }
+    command_free(&all);
+    return 0;
+}
+
+/*
+  @name package_string
+  @parameters char *package, bool libs
+  @description PRIVATE FUNCTION | Cflags or Libs of package as one string like pkg-config prints it, NULL if unknown
+  @returns char *
+*/
+static char *package_string(const char *package, bool libs) {
+    Command tokens = {0};
+    if (resolve_package(package, libs, &tokens) != 0) {
+        command_free(&tokens);
+        return NULL;
+    }
+    char *result = command_render(&tokens);
+    command_free(&tokens);
+    if (result) return result;
+    return calloc(1, 1);
+}
+
+/*
+  @name use_package
+  @parameters char *package
+  @description Adds the includes, library paths, libraries and other flags of a pkg-config package to the build
+  @returns int
+*/
+int use_package(const char *package) {
+    Command cflags = {0}, libs = {0};
+    if (resolve_package(package, false, &cflags) != 0 || resolve_package(package, true, &libs) != 0) {
+        // Not on our search path, pkg-config may still know it
+        command_free(&cflags);
+        command_free(&libs);
+        char *output;
+        for (int pass = 0; pass < 2; pass++) {
+            if (pkg_config_probe(pass == 0 ? "--cflags" : "--libs", package, &output) != 0) {
+                fprintf(stderr, "Error: Package '%s' not found.\n", package);
+                free(output);
+                command_free(&cflags);
+                command_free(&libs);
+                return S_ERROR;
+            }
+            command_push_split(pass == 0 ? &cflags : &libs, output);
+            free(output);
+        }
+    }
+
+    int result = 0;
+    for (size_t i = 0; i < cflags.count && result == 0; i++) {
+        const char *flag = cflags.items[i];
+        result = strncmp(flag, "-I", 2) == 0 && flag[2] ? define_include(flag + 2) : add_flag_word(flag);
+    }
+    for (size_t i = 0; i < libs.count && result == 0; i++) {
+        const char *flag = libs.items[i];
+        if (strncmp(flag, "-L", 2) == 0 && flag[2]) result = define_library_path(flag + 2);
+        else if (strncmp(flag, "-l", 2) == 0 && flag[2]) result = define_library(flag + 2);
+        else result = add_flag_word(flag);
+    }
+    command_free(&cflags);
+    command_free(&libs);
+    return result;
+}
+
+unsigned long build_steps_run = 0; // commands run_build_step actually executed, up-to-date steps are not counted
+
+// -- Job Server --
+// INFO: start_job_server shares one budget of compiler processes between the build and every process it forks afterwards
+static sem_t *job_tokens = NULL; // NULL = no shared budget, each process is only bounded by its own get_jobs()
+
+/*
+  @name start_job_server
+  @parameters int tokens
+  @description Lets at most tokens build steps run at the same time in this process and all processes forked after the call | samba_compiler calls it before it forks the targets
+  @returns int
+*/
+int start_job_server(int tokens) {
+    if (job_tokens) return 0;
+    void *memory = mmap(NULL, sizeof(sem_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return S_ERROR;
+    if (sem_init(memory, 1, tokens > 0 ? (unsigned int)tokens : 1) != 0) {
+        munmap(memory, sizeof(sem_t));
+        return S_ERROR;
+    }
+    job_tokens = memory;
+    return 0;
+}
+
+/*
+  @name job_token_acquire
+  @parameters void
+  @description PRIVATE FUNCTION | Waits for a token of the job server, if there is one
+  @returns void
+*/
+static void job_token_acquire() {
+    if (!job_tokens) return;
+    while (sem_wait(job_tokens) != 0 && errno == EINTR) {}
+}
+
+/*
+  @name job_token_release
+  @parameters void
+  @description PRIVATE FUNCTION | Returns a token taken with job_token_acquire
+  @returns void
+*/
+static void job_token_release() {
+    if (job_tokens) sem_post(job_tokens);
+}
+
+/*
+  @name run_build_step
+  @parameters char *label, char *output, Command *command, Command *run, char *depfile, char **inputs, size_t num_inputs, bool cacheable, bool *rebuilt
+  @description PRIVATE FUNCTION | Runs command unless output is up to date and keeps its .cmd file and hashes in sync | cacheable commands go through the object cache | run (may be NULL) is executed instead of command when a cheaper command produces the same output
+  @returns int
+*/
+static int run_build_step(const char *label, const char *output, const Command *command, const Command *run,
+                          const char *depfile, char **inputs, size_t num_inputs, bool cacheable, bool *rebuilt) {
+    char cmd_file[PATH_MAX + 8];
+    snprintf(cmd_file, sizeof(cmd_file), "%s.cmd", output);
+    if (rebuilt) *rebuilt = false;
+
+    char *signature = command_render(command);
+    char response_file[PATH_MAX + 8];
+    snprintf(response_file, sizeof(response_file), "%s.rsp", output);
+    if (output_up_to_date(output, cmd_file, signature, depfile, inputs, num_inputs)) {
+        verbose_log("Up to date: %s\n", label);
+        free(signature);
+        return 0;
+    }
+
+    verbose_log("Executing command: %s\n", signature);
+    __atomic_fetch_add(&build_steps_run, 1, __ATOMIC_RELAXED);
+    ProcessResult process = {0};
+    bool cache_hit = false;
+    job_token_acquire();
+    long long start = trace_now();
+    int status = (cacheable && cache_compilation) ? cached_compile(command, output, &process, &cache_hit)
+                                                  : run_compiler(run ? run : command, response_file, &process);
+    job_token_release();
+    trace_event(depfile ? "compile" : "link", label, signature, start, &process, cache_hit);
+    if (status != 0) {
+        unlink(cmd_file);
+        free(signature);
+        return S_ERROR;
+    }
+    if (!cache_hit) record_duration(output, process.wall_seconds);
+    write_command_file(cmd_file, signature);
+    free(signature);
+    output_built(output, depfile, inputs, num_inputs);
+    if (rebuilt) *rebuilt = true;
+    return 0;
+}
+
+// -- Link Time Optimization --
+// INFO: gcc compiles with -flto and links with -flto=<jobs> (parallel LTRANS), clang uses ThinLTO with a cache in build_directory/lto-cache
+// INFO: The .cmd signature of a link says jobs=auto, so a different -j does not relink
+#ifdef S_LTO_MODE
+    bool lto_mode = true;
+#else
+    bool lto_mode = false;
+#endif
+
+// Objects only hold IR, archives need the archiver with the LTO plugin to index them
+#ifndef S_LTO_AR
+    #ifdef S_CMP_CLANG
+        #define S_LTO_AR "llvm-ar"
+    #else
+        #define S_LTO_AR "gcc-ar"
+    #endif
+#endif
+
+// Entries not used for a week are dropped, the cache never grows past 2 GiB
+#ifndef S_LTO_CACHE_POLICY
+    #define S_LTO_CACHE_POLICY "prune_after=168h:cache_size_bytes=2g"
+#endif
+
+int get_jobs();
+
+/*
+  @name enable_lto
+  @parameters void
+  @description Enables link time optimization (same as defining S_LTO_MODE)
+  @returns void
+*/
+void enable_lto() {
+    lto_mode = true;
+}
+
+/*
+  @name append_lto_compile_flags
+  @parameters Command *command
+  @description PRIVATE FUNCTION | LTO flags of a compile, they do not depend on the job count so objects survive a different -j
+  @returns void
+*/
+static void append_lto_compile_flags(Command *command) {
+    if (!lto_mode) return;
+    #ifdef S_CMP_CLANG
+        command_push(command, "-flto=thin");
+    #else
+        command_push(command, "-flto");
+    #endif
+}
+
+/*
+  @name append_lto_link_flags
+  @parameters Command *command
+  @description PRIVATE FUNCTION | LTO flags of a link for its signature, the job count is left as auto so a different -j does not relink | lto_link_run fills it in
+  @returns void
+*/
+static void append_lto_link_flags(Command *command) {
+    if (!lto_mode) return;
+    #ifdef S_CMP_CLANG
+        char cache[PATH_MAX];
+        snprintf(cache, sizeof(cache), "%s/lto-cache", build_directory ? build_directory : ".");
+        command_push(command, "-flto=thin");
+        char lld[PATH_MAX];
+        if (find_in_path("ld.lld", lld, sizeof(lld))) {
+            command_push(command, "-fuse-ld=lld");
+            command_push(command, "-Wl,--thinlto-jobs=auto");
+            command_pushf(command, "-Wl,--thinlto-cache-dir=%s", cache);
+            command_push(command, "-Wl,--thinlto-cache-policy=" S_LTO_CACHE_POLICY);
+        } else {
+            // LLVMgold plugin of ld.bfd and gold
+            command_push(command, "-Wl,-plugin-opt,jobs=auto");
+            command_pushf(command, "-Wl,-plugin-opt,cache-dir=%s", cache);
+            command_push(command, "-Wl,-plugin-opt,cache-policy=" S_LTO_CACHE_POLICY);
+        }
+    #else
+        command_push(command, "-flto=auto");
+    #endif
+}
+
+/*
+  @name lto_link_run
+  @parameters Command *signature, Command *run
+  @description PRIVATE FUNCTION | Copies a link command and replaces the auto job count of append_lto_link_flags with get_jobs()
+  @returns bool, false without LTO (run stays empty and the signature is executed)
+*/
+static bool lto_link_run(const Command *signature, Command *run) {
+    if (!lto_mode) return false;
+    static const char *job_flags[] = {"-flto=", "-Wl,--thinlto-jobs=", "-Wl,-plugin-opt,jobs="};
+    for (size_t i = 0; i < signature->count; i++) {
+        const char *item = signature->items[i];
+        size_t j = 0;
+        while (j < sizeof(job_flags) / sizeof(job_flags[0]) &&
+               !(strncmp(item, job_flags[j], strlen(job_flags[j])) == 0 && strcmp(item + strlen(job_flags[j]), "auto") == 0)) j++;
+        if (j < sizeof(job_flags) / sizeof(job_flags[0])) command_pushf(run, "%s%d", job_flags[j], get_jobs());
+        else command_push(run, item);
+    }
+    return true;
+}
+
+// -- Profile Guided Optimization --
+// INFO: enable_pgo(training) makes compile_target build instrumented, run training, and build again with the profile
+// INFO: Profiles live in build_directory/pgo/<target>, they are retrained when more than S_PGO_STALE_FRACTION of the sources changed
+#ifndef S_PGO_STALE_FRACTION
+    #define S_PGO_STALE_FRACTION 0.25
+#endif
+
+char *pgo_training = NULL; // shell command, $SAMBA_PGO_BINARY is the instrumented binary
+
+typedef struct {
+    Command flags;          // added to every compile and the link
+    bool object_profiles;   // gcc: every object reads the .gcda next to it
+    char profile[PATH_MAX]; // clang: every object reads this .profdata
+} PgoPhase;
+
+/*
+  @name enable_pgo
+  @parameters char *training_command
+  @description Builds the following compile_target calls profile guided, training_command runs the instrumented binary (as $SAMBA_PGO_BINARY), e.g. enable_pgo("$SAMBA_PGO_BINARY --benchmark")
+  @returns int
+*/
+int enable_pgo(const char *training_command) {
+    pgo_training = settings_string(training_command);
+    return pgo_training ? 0 : S_ERROR;
+}
+
+/*
+  @name append_compile_flags
+  @parameters Command *command
+  @description PRIVATE FUNCTION | Appends variables, includes and flags
+  @returns void
+*/
+static void append_compile_flags(Command *command) {
+    for (size_t i = 0; i < num_variables; i++) {
+        if (!variables[i].key) continue;
+        command_pushf(command, "-D%s=\"%s\"", variables[i].key, variables[i].value);
+    }
+    for (size_t i = 0; i < num_includes; i++) {
+        if (!includes[i].key) continue;
+        command_pushf(command, "-I%s", includes[i].key);
+    }
+    for (size_t i = 0; i < num_flags; i++) {
+        if (!flags[i]) continue;
+        command_push(command, flags[i]);
+    }
+    append_lto_compile_flags(command);
+}
+
+/*
+  @name append_link_libraries
+  @parameters Command *command
+  @description PRIVATE FUNCTION | Appends library paths and libraries
+  @returns void
+*/
+static void append_link_libraries(Command *command) {
+    for (size_t i = 0; i < num_library_paths; i++) {
+        if (!library_paths[i].key) continue;
+        command_pushf(command, "-L%s", library_paths[i].key);
+    }
+    for (size_t i = 0; i < num_libraries; i++) {
+        if (!libraries[i].key) continue;
+        command_pushf(command, "-l%s", libraries[i].key);
+    }
+}
+
+/*
+  @name append_library_files
+  @parameters Command *inputs
+  @description PRIVATE FUNCTION | Appends the file every library resolves to in the library paths (lib<name>.so before lib<name>.a, like ld), so a link reruns when one changes | system directories are not searched
+  @returns void
+*/
+static void append_library_files(Command *inputs) {
+    for (size_t i = 0; i < num_libraries; i++) {
+        if (!libraries[i].key) continue;
+        const char *name = libraries[i].key;
+        for (size_t j = 0; j < num_library_paths; j++) {
+            if (!library_paths[j].key) continue;
+            char path[PATH_MAX];
+            // -l:file names the file itself
+            if (name[0] == ':') snprintf(path, sizeof(path), "%s/%s", library_paths[j].key, name + 1);
+            else snprintf(path, sizeof(path), "%s/lib%s.so", library_paths[j].key, name);
+            if (access(path, F_OK) != 0 && name[0] != ':') snprintf(path, sizeof(path), "%s/lib%s.a", library_paths[j].key, name);
+            if (access(path, F_OK) == 0) {
+                command_push(inputs, path);
+                break;
+            }
+        }
+    }
+}
+
+/*
+  @name prepare_precompiled_header
+  @parameters Command *use, bool pic, PrecompiledHeader *pch
+  @description PRIVATE FUNCTION | Builds the precompiled header for the current flags if needed and returns the arguments that use it, pch gets its paths | concurrent builds of the same header wait on <pch>.lock
+  @returns int
+*/
+static int prepare_precompiled_header(Command *use, bool pic, PrecompiledHeader *pch) {
+    if (!precompiled_header) return 0;
+
+    Command command = {0};
+    command_push_split(&command, S_COMPILER);
+    append_compile_flags(&command);
+    if (pic) command_push(&command, "-fPIC");
+
+    // One directory per flag set, so targets with different flags never share a header
+    char *signature = command_render(&command);
+    uint64_t flags_hash = hash_bytes(S_HASH_SEED, signature, strlen(signature));
+    free(signature);
+
+    const char *name = strrchr(precompiled_header, '/');
+    name = name ? name + 1 : precompiled_header;
+    char *pch_path = pch->output, depfile[PATH_MAX + 16], lock_path[PATH_MAX + 16];
+    snprintf(pch->include, sizeof(pch->include), "%s/pch/%016llx/%s", build_directory ? build_directory : ".",
+             (unsigned long long)flags_hash, name);
+    #ifdef S_CMP_CLANG
+        snprintf(pch->output, sizeof(pch->output), "%s.pch", pch->include);
+        snprintf(pch->include, sizeof(pch->include), "%s", pch->output);
+    #else
+        snprintf(pch->output, sizeof(pch->output), "%s.gch", pch->include);
+    #endif
+    snprintf(depfile, sizeof(depfile), "%s.d", pch_path);
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", pch_path);
+    int lock = create_parent_directories(pch_path) == 0 ? open(lock_path, O_RDWR | O_CREAT, 0644) : -1;
+    if (lock < 0) {
+        fprintf(stderr, "Error: Unable to create '%s'.\n", lock_path);
+        command_free(&command);
+        return S_ERROR;
+    }
+
+    command_push(&command, "-x");
+    command_push(&command, "c-header");
+    command_push(&command, "-MMD");
+    command_push(&command, "-MF");
+    command_push(&command, depfile);
+    command_push(&command, "-o");
+    command_push(&command, pch_path);
+    command_push(&command, precompiled_header);
+
+    // Parallel compile() calls and forked targets with the same flags share the header, one builds it and the others find it up to date
+    flock(lock, LOCK_EX);
+    bool rebuilt;
+    int result = run_build_step(precompiled_header, pch_path, &command, NULL, depfile, NULL, 0, false, &rebuilt);
+    flock(lock, LOCK_UN);
+    close(lock);
+    command_free(&command);
+    if (result != 0) {
+        fprintf(stderr, "Error: Precompiling '%s' failed.\n", precompiled_header);
+        return S_ERROR;
+    }
+    if (rebuilt) printf("Precompiled header: %s\n", precompiled_header);
+
+    #ifdef S_CMP_CLANG
+        command_push(use, "-include-pch");
+    #else
+        command_push(use, "-include");
+    #endif
+    command_push(use, pch->include);
+    return 0;
+}
+
+/*
+  @name compile
+  @parameters char *script_file, char *output_file, bool create_shared
+  @description Compiles a script file into an executable file with all given configuration. Skips the compiler if neither the sources, their included headers nor the command changed since the last build. | script_file is exactly one source and is passed as one argument (spaces included), several sources go through compile_target
+  @returns int
+*/
+int compile(const char *script_file, const char *output_file, bool create_shared) {
+    Command command = {0};
+    command_push_split(&command, S_COMPILER);
+
+    for (size_t i = 0; i < num_variables; i++) {
+        if (!variables[i].key) continue;
+        command_pushf(&command, "-D%s=\"%s\"", variables[i].key, variables[i].value);
+    }
+    for (size_t i = 0; i < num_includes; i++) {
+        if (!includes[i].key) continue;
+        command_pushf(&command, "-I%s", includes[i].key);
+    }
+    for (size_t i = 0; i < num_flags; i++) {
+        if (!flags[i]) continue;
+        command_push(&command, flags[i]);
+    }
+    if (create_shared) {
+        command_push(&command, "-shared");
+    }
+    append_lto_link_flags(&command);
+    PrecompiledHeader pch;
+    if (prepare_precompiled_header(&command, false, &pch) != 0) {
+        command_free(&command);
+        return S_ERROR;
+    }
+
+    char output_path[PATH_MAX];
+    if (build_directory == NULL) {
+        snprintf(output_path, sizeof(output_path), "%s", output_file);
+    }
+    else {
+        snprintf(output_path, sizeof(output_path), "%s/%s", build_directory, output_file);
+        ensure_build_directory();
+    }
+
+    // Depfile and command file live next to the output
+    char depfile[PATH_MAX + 8];
+    snprintf(depfile, sizeof(depfile), "%s.d", output_path);
+    command_push(&command, "-MMD");
+    command_push(&command, "-MF");
+    command_push(&command, depfile);
+    command_push(&command, "-o");
+    command_push(&command, output_path);
+    command_push(&command, script_file);
+    // After the source, ld only takes what is still undefined from an archive
+    append_link_libraries(&command);
+
+    record_compile_command(script_file, output_path, &command);
+    bool rebuilt;
+    Command inputs = {0};
+    if (precompiled_header) command_push(&inputs, pch.output);
+    append_library_files(&inputs);
+    Command run = {0};
+    bool lto = lto_link_run(&command, &run);
+    int result = run_build_step(output_file, output_path, &command, lto ? &run : NULL, depfile, inputs.items, inputs.count, false, &rebuilt);
+    command_free(&command);
+    command_free(&run);
+    command_free(&inputs);
+
+    if (result != 0) {
+        fprintf(stderr, "Error: Compilation failed.\n");
+        return S_ERROR;
+    }
+    if (rebuilt) printf("Compilation successful: %s\n", output_file);
+    return 0;
+}
+
+/*
+  @name free_all
+  @parameters void
+  @description Frees All
+  @returns void
+*/
+void free_all() {
+    free(libraries);
+    free(includes);
+    free(library_paths);
+    free(variables);
+    free(flags);
+    free(unity_excluded);
+    arena_free(&settings_arena);
+    settings_index_free(&libraries_index);
+    settings_index_free(&includes_index);
+    settings_index_free(&library_paths_index);
+    settings_index_free(&variables_index);
+    settings_index_free(&flags_index);
+    libraries = includes = library_paths = variables = NULL;
+    flags = unity_excluded = NULL;
+    precompiled_header = NULL;
+    pgo_training = NULL;
+    num_libraries = num_includes = num_library_paths = num_variables = num_flags = num_unity_excluded = 0;
+    libraries_capacity = includes_capacity = library_paths_capacity = variables_capacity = flags_capacity = unity_excluded_capacity = 0;
+}
+
+/*
+  @name reset_settings
+  @parameters void
+  @description Clears all settings in O(1), the arrays and the arena are kept for the next target | Is made if your wanna make 2 targets or more with different flags
+  @returns void
+*/
+void reset_settings() {
+    num_libraries = num_includes = num_library_paths = num_variables = num_flags = num_unity_excluded = 0;
+    libraries_index.removed = includes_index.removed = library_paths_index.removed = variables_index.removed = flags_index.removed = 0;
+    precompiled_header = NULL;
+    pgo_training = NULL;
+    settings_generation++;
+    arena_reset(&settings_arena);
+    #undef verbose_mode
+    #define verbose_mode false
+}
+
+/*
+  @name needs_rebuild
+  @parameters char *source_file, char *executable
+  @description Used in SAMBA_GO_REBUILD_URSELF | you can also use it
+  @returns int
+*/
+int needs_rebuild(const char *source_file, const char *executable) {
+    struct stat source_stat, exe_stat;
+
+    if (stat(source_file, &source_stat) != 0) {
+        fprintf(stderr, "Error: Source file '%s' not found.\n", source_file);
+        return 1;
+    }
+
+    if (stat(executable, &exe_stat) != 0) {
+        fprintf(stderr, "Warning: Executable '%s' not found.\n", executable);
+        return 1;
+    }
+
+    if (is_newer(&source_stat, &exe_stat)) {
+        if (content_hash_mode && hash_db_matches(executable, source_file, &source_stat)
+                              && hash_db_matches(executable, executable, &exe_stat)) {
+            #ifndef S_REBUILD_NO_OUTPUT
+                verbose_log("Source file '%s' is unchanged by content. Skipping rebuild.\n", source_file);
+            #endif
+            utimensat(AT_FDCWD, executable, NULL, 0);
+            return 0;
+        }
+        #ifndef S_REBUILD_NO_OUTPUT
+            verbose_log("Source file '%s' is newer than executable '%s'. Rebuild required.\n", source_file, executable);
+        #endif
+
+        return 1;
+    }
+
+    #ifndef S_REBUILD_NO_OUTPUT
+        verbose_log("Executable '%s' is up-to-date. Running...\n", executable);
+    #endif
+    return 0;
+}
+
+/*
+  @name file_exists
+  @parameters char *path
+  @description Checks if the given file exists
+  @returns bool
+*/
+bool file_exists(const char *path) {
+    struct stat buffer;
+    return (stat(path, &buffer) == 0);
+}
+
+/*
+  @name SAMBA_GO_REBUILD_URSELF
+  @parameters void
+  @description Checks if the samba.c binary is uptodate | Idea taken from tsoding | Implementation self made
+  @returns void
+*/
+void SAMBA_GO_REBUILD_URSELF() {
+    const char *source_file = "samba.c";
+    const char *executable = "samba";
+
+    if (needs_rebuild(source_file, executable) == 1) {
+        #ifndef S_REBUILD_NO_OUTPUT
+            verbose_log("Rebuilding '%s' from source '%s'.\n", executable, source_file);
+        #endif
+        if (run_args("gcc", "-o", executable, source_file, "-O2", "-DNDEBUG", "-s", NULL) != 0) {
+            exit_error(__func__, "Build failed\n");
+        }
+        if (content_hash_mode) {
+            char *inputs[] = {(char *)source_file};
+            record_build_hashes(executable, inputs, 1);
+        }
+
+        #ifndef S_REBUILD_NO_OUTPUT
+            verbose_log("Build completed successfully.\n");
+        #endif
+
+        run_args("clear", NULL);
+
+        #ifndef S_REBUILD_NO_OUTPUT
+            verbose_log("Executing '%s'...\n", executable);
+        #endif
+        if (run_args("./samba", NULL) != 0) {
+            exit_error(__func__, "Execution failed\n");
+        }
+    }
+}
+
+/*
+  @name initialize_build_flags
+  @parameters void
+  @description Inits the build flags (S_RELEASE_MODE or S_DEBUG_MODE)
+  @returns void
+*/
+void initialize_build_flags() {
+    // Modes
+    #ifdef S_RELEASE_MODE
+        add_flag("-O2");
+        add_flag("-DNDEBUG");
+        add_flag("-s");
+    #endif
+
+    #ifdef S_DEBUG_MODE
+        add_flag("-O0");
+        add_flag("-g");
+    #endif
+
+    // Integrate Samba Vars to the output executable
+    define_variable("S_VERSION", S_VERSION);
+    define_variable("S_COMPILER", S_COMPILER);
+}
+
+/*
+  @name find_library
+  @parameters char *library
+  @description Finds libs for the given library from its .pc file, falls back to pkg-config (cached) | NULL if the library is unknown
+  @returns char *
+*/
+char *find_library(const char *library) {
+    char *result = package_string(library, true);
+    if (result) return result;
+    if (pkg_config_probe("--libs", library, &result) != 0) {
+        free(result);
+        return NULL;
+    }
+    return result;
+}
+
+/*
+  @name find_flags
+  @parameters char *library
+  @description Finds flags for the given library from its .pc file, falls back to pkg-config (cached) | NULL if the library is unknown
+  @returns char *
+*/
+char *find_flags(const char *library) {
+    char *result = package_string(library, false);
+    if (result) return result;
+    if (pkg_config_probe("--cflags", library, &result) != 0) {
+        free(result);
+        return NULL;
+    }
+    return result;
+}
+
+/*
+  @name s_command
+  @parameters char *fmt, ...
+  @description Simple function for executing a shell command (/bin/sh -c) and loging if verbose mode is enabled also supports fmt | use run_args when no shell is needed
+  @returns int
+*/
+int s_command(char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int length = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    char *command = length < 0 ? NULL : malloc((size_t)length + 1);
+    if (!command) return S_ERROR;
+
+    va_start(args, fmt);
+    vsnprintf(command, (size_t)length + 1, fmt, args);
+    va_end(args);
+
+    int result = run_args("/bin/sh", "-c", command, NULL);
+    free(command);
+    return result;
+}
+
+//////////////////////////////////////////////////
+//////////////////////////////////////////////////
+               // V 1.1
+//////////////////////////////////////////////////
+//////////////////////////////////////////////////
+
+/*
+  @name set_build_directory
+  @parameters char *path
+  @description Sets the build directory to the given path
+  @returns void
+*/
+void set_build_directory(const char *path) {
+    build_directory = NULL;
+    build_directory = strdup(path);
+    if (!build_directory) {
+        exit_error(__func__, "Failed to set build directory");
+    }
+}
+
+/*
+  @name print_libraries
+  @parameters void
+  @description Prints the libraries
+  @returns void
+*/
+void print_libraries() {
+    printf("Libraries:\n");
+    for (size_t i = 0; i < num_libraries; i++) {
+        if (!libraries[i].key) continue;
+        printf(" - %s\n", libraries[i].key);
+    }
+}
+
+/*
+  @name create_build_directory
+  @parameters void
+  @description Clears the build directory
+  @returns void
+*/
+void clear_build_directory() {
+    verbose_log("Clearing build directory: %s\n", build_directory);
+
+    int result = run_args("rm", "-rf", build_directory, NULL);
+    if (result != 0) {
+        fprintf(stderr, "Error: Failed to clear build directory.\n");
+    }
+
+}
+
+/*
+  @name generate_build_report_to_file
+  @parameters char *filename
+  @description Generates a build report and writes it to a file
+  @returns void
+*/
+void generate_build_report_to_file(const char *filename) {
+    verbose_log("Generating build report to file: %s\n", filename);
+    FILE *file = fopen(filename, "w");
+
+    if (file == NULL) {
+        fprintf(stderr, "Error: Unable to open file %s for writing.\n", filename);
+        return;
+    }
+
+    fprintf(file, "Build Configuration Report:\n");
+    fprintf(file, "- Compiler: %s\n", S_COMPILER);
+    fprintf(file, "- Flags: ");
+    if (num_flags == flags_index.removed) {
+        fprintf(file, "\n  - None\n");
+    } else {
+        for (size_t i = 0; i < num_flags; i++) {
+            if (!flags[i]) continue;
+            fprintf(file, "\n  - %s", flags[i]);
+        }
+    }
+
+    fprintf(file, "\n- Libraries: ");
+    if (num_libraries == libraries_index.removed) {
+        fprintf(file, "\n  - None\n");
+    } else {
+        for (size_t i = 0; i < num_libraries; i++) {
+            if (!libraries[i].key) continue;
+            fprintf(file, "\n  - %s", libraries[i].key);
+        }
+    }
+    fprintf(file, "\n- Includes: ");
+    if (num_includes == includes_index.removed) {
+        fprintf(file, "\n  - None\n");
+    } else {
+        for (size_t i = 0; i < num_includes; i++) {
+            if (!includes[i].key) continue;
+            fprintf(file, "\n  - %s", includes[i].key);
+        }
+    }
+
+    fprintf(file, "\n");
+
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Error: Failed to close file %s.\n", filename);
+    } else {
+        printf("Build report successfully written to %s.\n", filename);
+    }
+
+    if (chmod(filename, 0755) != 0) {
+        fprintf(stderr, "Error: Failed to chmod %s.\n", filename);
+    }
+}
+
+/*
+  @name generate_timestamp_file
+  @parameters void
+  @description Generates a timestamp file with the current date and time
+  @returns void
+*/
+void generate_timestamp_file() {
+    FILE *file = fopen("build.timestamp", "w");
+    if (file) {
+        time_t now = time(NULL);
+        fprintf(file, "Last build: %s", ctime(&now));
+        fclose(file);
+        verbose_log("Build timestamp generated.\n");
+    } else {
+        fprintf(stderr, "Error generating timestamp file.\n");
+    }
+}
+
+// -- Strip Prefix --
+#ifdef S_STRIP_PREFIX
+    #define AUTO S_AUTO
+    #define CACHE_COMPILATION S_CACHE_COMPILATION
+    #define VERBOSE_MODE S_VERBOSE_MODE
+    #define OS S_OS
+    #define CMP_CLANG S_CMP_CLANG
+    #define RELEASE_MODE S_RELEASE_MODE
+    #define DEBUG_MODE S_DEBUG_MODE
+    #define SUDO S_SUDO
+    #define GO_REBUILD_URSELF SAMBA_GO_REBUILD_URSELF
+#endif
+
+
+// ! WORKS ONLY ON Red Hat based distros and on Debian based distros
+/*
+  @name check_and_install_dependency
+  @parameters char *tool
+  @description Checks if a dependency is installed and installs it if not
+  @returns void
+*/
+void check_and_install_dependency(const char *tool) {
+    if (!check_tool(tool)) {
+        verbose_log("Dependency '%s' not found. Attempting to install...\n", tool);
+        if (check_tool("dnf")) {
+            run_args("sudo", "dnf", "install", "-y", tool, NULL);
+        } else if (check_tool("apt-get")) {
+            run_args("sudo", "apt-get", "install", "-y", tool, NULL);
+        } else {
+            fprintf(stderr, "Error: Package manager not found. Please install '%s' manually.\n", tool);
+        }
+    } else {
+        verbose_log("Dependency '%s' is already installed.\n", tool);
+    }
+}
+
+/*
+  @name interactive_menu
+  @parameters void
+  @description A simple interactive menu for Samba
+  @returns void
+*/
+void interactive_menu() {
+    int choice;
+    do {
+        printf("\n--- Samba Menu ---\n");
+        printf("1. Add Library\n");
+        printf("2. Add Include Path\n");
+        printf("3. Set Build Directory\n");
+        printf("4. Compile\n");
+        printf("5. Exit\n");
+        printf("Enter your choice: ");
+        scanf("%d", &choice);
+
+        switch (choice) {
+            case 1:
+                {
+                    char lib[256];
+                    printf("Enter library name: ");
+                    scanf("%s", lib);
+                    define_library(lib);
+                }
+                break;
+            case 2:
+                {
+                    char path[256];
+                    printf("Enter include path: ");
+                    scanf("%s", path);
+                    define_include(path);
+                }
+                break;
+            case 3:
+                {
+                    char dir[256];
+                    printf("Enter build directory: ");
+                    scanf("%s", dir);
+                    set_build_directory(dir);
+                }
+                break;
+            case 4:
+                {
+                    char src[256], out[256];
+                    printf("Enter source file: ");
+                    scanf("%s", src);
+                    printf("Enter output file: ");
+                    scanf("%s", out);
+                    compile(src, out, false);
+                }
+                break;
+            case 5:
+                printf("Exiting menu.\n");
+                break;
+            default:
+                printf("Invalid choice. Try again.\n");
+        }
+    } while (choice != 5);
+}
+
+/*
+  @name add_memory_sanitizer
+  @parameters void
+  @description Adds memory sanitizer flags to the flags
+  @returns void
+*/
+void add_memory_sanitizer() {
+    add_flag("-fsanitize=address");
+    add_flag("-fsanitize=undefined");
+}
+
+/*
+  @name add_compiler_warnings
+  @parameters void
+  @description Adds compiler warnings to the flags
+  @returns void
+*/
+void add_compiler_warnings() {
+    add_flag("-Wall");
+    add_flag("-Wextra");
+    add_flag("-pedantic");
+}
+
+/*
+  @name send_notification
+  @parameters char *app_name, char *title, char *message
+  @description Sends a notification using the notify-send command
+  @returns void
+*/
+void send_notification(const char *app_name, const char *title, const char *message) {
+    run_args("notify-send", title, message, "-a", app_name, NULL);
+}
+
+/*
+  @name list_defined_variables
+  @parameters void
+  @description Prints all defined vars
+  @returns void
+*/
+void list_defined_variables() {
+    printf("Defined Variables:\n");
+    for (size_t i = 0; i < num_variables; i++) {
+        if (!variables[i].key) continue;
+        printf(" - %s = %s\n", variables[i].key, variables[i].value);
+    }
+}
+
+/*
+  @name get_current_datetime
+  @parameters char *buffer, size_t buffer_size
+  @description Get current datetime and store it in the buffer
+  @returns void
+*/
+void get_current_datetime(char *buffer, size_t buffer_size) {
+    time_t now = time(NULL);
+    struct tm *tm_info = localtime(&now);
+    strftime(buffer, buffer_size, "%Y-%m-%d %H:%M:%S", tm_info);
+}
+
+/*
+  @name is_internet_available
+  @parameters void
+  @description Checks if internet is available
+  @returns bool
+*/
+bool is_internet_available() {
+    char buffer[256];
+    FILE *fp = popen("ping -c 1 8.8.8.8 > /dev/null 2>&1", "r");
+    if (fp == NULL) {
+        return false;
+    }
+    fclose(fp);
+    return true;
+}
+
+
+/*
+  @name list_files_in_directory
+  @parameters char *dir_path
+  @description Print all files in a directory
+  @returns void
+*/
+void list_files_in_directory(const char *dir_path) {
+    struct dirent *entry;
+    DIR *dp = opendir(dir_path);
+    if (dp == NULL) {
+        perror("Error opening directory");
+        return;
+    }
+
+    while ((entry = readdir(dp)) != NULL) {
+        printf("%s\n", entry->d_name);
+    }
+
+    closedir(dp);
+}
+
+
+/*
+  @name get_process_id
+  @parameters void
+  @description Get the process ID of the current process
+  @returns pid_t
+*/
+pid_t get_process_id() {
+    return getpid();
+}
+
+
+/*
+  @name check_library
+  @parameters char *library
+  @description Checks if a library is installed, from its .pc file or else pkg-config (cached, see pkg_config_probe)
+  @returns bool
+*/
+bool check_library(const char *library) {
+    PcFile pc;
+    if (pc_load(library, &pc) == 0) {
+        pc_free(&pc);
+        return true;
+    }
+    char *output;
+    bool found = pkg_config_probe("--exists", library, &output) == 0;
+    free(output);
+    return found;
+}
+
+/*
+  @name add_no_debug
+  @parameters void
+  @description Sets the NDEBUG flag
+  @returns void
+*/
+void add_no_debug() {
+    add_flag("-DNDEBUG");
+}
+
+// -- Job Scheduler --
+#ifdef S_JOBS
+    int max_jobs = S_JOBS;
+#else
+    int max_jobs = 0; // 0 = number of online CPUs
+#endif
+
+typedef struct {
+    int (*run)(void *arg);
+    void *arg;
+    long priority; // Higher starts first, equal priorities start in FIFO order (see job_priority)
+    int result;
+} SambaJob;
+
+typedef struct {
+    SambaJob *jobs;
+    size_t *heap;
+    size_t heap_size;
+    size_t finished;
+    int failed;
+    int workers; // slots handed out so far, the trace shows each worker as its own thread
+    pthread_mutex_t mutex;
+} JobQueue;
+
+/*
+  @name job_priority
+  @parameters double seconds
+  @description Priority of a job that heads a chain of the given length, so the longest chains start first
+  @returns long
+*/
+long job_priority(double seconds) {
+    return (long)(seconds * 1000000.0);
+}
+
+/*
+  @name set_jobs
+  @parameters int jobs
+  @description Sets how many jobs run at the same time (0 = number of online CPUs)
+  @returns void
+*/
+void set_jobs(int jobs) {
+    max_jobs = jobs < 0 ? 0 : jobs;
+}
+
+/*
+  @name get_jobs
+  @parameters void
+  @description Returns how many jobs run at the same time
+  @returns int
+*/
+int get_jobs() {
+    if (max_jobs > 0) return max_jobs;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+/*
+  @name job_before
+  @parameters JobQueue *queue, size_t a, size_t b
+  @description PRIVATE FUNCTION | Heap order: higher priority first, then submission order
+  @returns bool
+*/
+static bool job_before(JobQueue *queue, size_t a, size_t b) {
+    if (queue->jobs[a].priority != queue->jobs[b].priority) return queue->jobs[a].priority > queue->jobs[b].priority;
+    return a < b;
+}
+
+/*
+  @name job_queue_push
+  @parameters JobQueue *queue, size_t job
+  @description PRIVATE FUNCTION | Adds a job to the pending heap
+  @returns void
+*/
+static void job_queue_push(JobQueue *queue, size_t job) {
+    size_t i = queue->heap_size++;
+    queue->heap[i] = job;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!job_before(queue, queue->heap[i], queue->heap[parent])) break;
+        size_t temp = queue->heap[i];
+        queue->heap[i] = queue->heap[parent];
+        queue->heap[parent] = temp;
+        i = parent;
+    }
+}
+
+/*
+  @name job_queue_pop
+  @parameters JobQueue *queue
+  @description PRIVATE FUNCTION | Removes the next job from the pending heap
+  @returns size_t
+*/
+static size_t job_queue_pop(JobQueue *queue) {
+    size_t top = queue->heap[0];
+    queue->heap[0] = queue->heap[--queue->heap_size];
+    size_t i = 0;
+    for (;;) {
+        size_t left = i * 2 + 1, right = left + 1, best = i;
+        if (left < queue->heap_size && job_before(queue, queue->heap[left], queue->heap[best])) best = left;
+        if (right < queue->heap_size && job_before(queue, queue->heap[right], queue->heap[best])) best = right;
+        if (best == i) break;
+        size_t temp = queue->heap[i];
+        queue->heap[i] = queue->heap[best];
+        queue->heap[best] = temp;
+        i = best;
+    }
+    return top;
+}
+
+/*
+  @name job_worker
+  @parameters void *arg
+  @description PRIVATE FUNCTION | Worker thread, runs jobs until the queue is empty
+  @returns void *
+*/
+static void *job_worker(void *arg) {
+    JobQueue *queue = arg;
+    int previous_slot = worker_slot;
+    pthread_mutex_lock(&queue->mutex);
+    worker_slot = queue->workers++;
+    pthread_mutex_unlock(&queue->mutex);
+
+    for (;;) {
+        pthread_mutex_lock(&queue->mutex);
+        if (queue->heap_size == 0) {
+            pthread_mutex_unlock(&queue->mutex);
+            worker_slot = previous_slot;
+            return NULL;
+        }
+        size_t index = job_queue_pop(queue);
+        pthread_mutex_unlock(&queue->mutex);
+
+        SambaJob *job = &queue->jobs[index];
+        job->result = job->run(job->arg);
+
+        pthread_mutex_lock(&queue->mutex);
+        queue->finished++;
+        if (job->result != 0) queue->failed++;
+        pthread_mutex_unlock(&queue->mutex);
+    }
+}
+
+/*
+  @name run_jobs
+  @parameters SambaJob *jobs, size_t num_jobs
+  @description Runs the jobs on a pool of get_jobs() worker threads | each job's return value is stored in its result
+  @returns int | 0 if every job returned 0, otherwise S_ERROR
+*/
+int run_jobs(SambaJob *jobs, size_t num_jobs) {
+    if (num_jobs == 0) return 0;
+
+    JobQueue queue = {0};
+    queue.jobs = jobs;
+    queue.heap = malloc(sizeof(size_t) * num_jobs);
+    if (!queue.heap) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return S_ERROR;
+    }
+    pthread_mutex_init(&queue.mutex, NULL);
+    for (size_t i = 0; i < num_jobs; i++) {
+        jobs[i].result = 0;
+        job_queue_push(&queue, i);
+    }
+
+    size_t num_workers = (size_t)get_jobs();
+    if (num_workers > num_jobs) num_workers = num_jobs;
+    verbose_log("Running %zu jobs on %zu workers.\n", num_jobs, num_workers);
+
+    pthread_t *workers = malloc(sizeof(pthread_t) * num_workers);
+    size_t started = 0;
+    if (workers) {
+        // The calling thread is one of the workers
+        for (; started + 1 < num_workers; started++) {
+            if (pthread_create(&workers[started], NULL, job_worker, &queue) != 0) {
+                fprintf(stderr, "Warning: Unable to create thread, continuing with %zu workers\n", started + 1);
+                break;
+            }
+        }
+    }
+    job_worker(&queue);
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(workers);
+    free(queue.heap);
+    pthread_mutex_destroy(&queue.mutex);
+    return queue.failed == 0 ? 0 : S_ERROR;
+}
+
+typedef struct {
+    char *target;
+    char *output;
+    bool create_shared;
+} compile_args_t;
+
+/*
+  @name compile_job
+  @parameters void *args
+  @description PRIVATE FUNCTION | Job entry for compile_parallel
+  @returns int
+*/
+static int compile_job(void *args) {
+    compile_args_t *compile_args = (compile_args_t *)args;
+    return compile(compile_args->target, compile_args->output, compile_args->create_shared);
+}
+
+/*
+  @name compile_parallel
+  @parameters char **targets, char **outputs, int num_targets
+  @description Compiles the targets in parallel on at most get_jobs() workers (see set_jobs / S_JOBS)
+  @returns int | 0 if every target compiled, otherwise S_ERROR
+*/
+int compile_parallel(char **targets, char **outputs, int num_targets) {
+    if (num_targets <= 0) return 0;
+
+    SambaJob *jobs = calloc((size_t)num_targets, sizeof(SambaJob));
+    compile_args_t *args = calloc((size_t)num_targets, sizeof(compile_args_t));
+    if (!jobs || !args) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(jobs);
+        free(args);
+        return S_ERROR;
+    }
+
+    for (int i = 0; i < num_targets; i++) {
+        args[i].target = targets[i];
+        args[i].output = outputs[i];
+        args[i].create_shared = false;
+        jobs[i].run = compile_job;
+        jobs[i].arg = &args[i];
+
+        char output_path[PATH_MAX];
+        if (build_directory == NULL) snprintf(output_path, sizeof(output_path), "%s", outputs[i]);
+        else snprintf(output_path, sizeof(output_path), "%s/%s", build_directory, outputs[i]);
+        jobs[i].priority = job_priority(estimate_duration(output_path, &targets[i], 1));
+    }
+
+    int result = run_jobs(jobs, (size_t)num_targets);
+    if (result != 0) {
+        int failed = 0;
+        for (int i = 0; i < num_targets; i++) {
+            if (jobs[i].result != 0) failed++;
+        }
+        fprintf(stderr, "Error: %d of %d targets failed.\n", failed, num_targets);
+    }
+
+    free(jobs);
+    free(args);
+    return result;
+}
+
+typedef struct {
+    char path[PATH_MAX];
+    char **members;
+    size_t num_members;
+} UnityBatch;
+
+typedef struct {
+    const char *source;
+    char object[PATH_MAX];
+    Command command;
+    char *extra_inputs[2]; // the precompiled header and the profile, compilers leave both out of the depfile
+    size_t num_extra_inputs;
+    char profile[PATH_MAX + 8]; // gcc PGO: the .gcda next to the object
+    const UnityBatch *batch; // set when source is a unity batch
+    bool rebuilt;
+} ObjectJob;
+
+/*
+  @name object_path_for
+  @parameters char *buffer, size_t size, char *output_file, char *source
+  @description PRIVATE FUNCTION | build_directory/obj/<output_file>/<source>.o, absolute and ../ components are kept inside obj/
+  @returns void
+*/
+static void object_path_for(char *buffer, size_t size, const char *output_file, const char *source) {
+    int written = snprintf(buffer, size, "%s/obj/%s/", build_directory ? build_directory : ".", output_file);
+    if (written < 0 || (size_t)written >= size) return;
+    size_t length = (size_t)written;
+
+    for (const char *in = source; *in && length + 3 < size; in++) {
+        if (*in == '/' && (in == source || in[-1] == '/')) continue;
+        if (in[0] == '.' && in[1] == '.' && (in == source || in[-1] == '/') && (in[2] == '/' || in[2] == '\0')) {
+            buffer[length++] = '_';
+            buffer[length++] = '_';
+            in++;
+            continue;
+        }
+        buffer[length++] = *in;
+    }
+    snprintf(buffer + length, size - length, ".o");
+}
+
+/*
+  @name unity_member_seconds
+  @parameters char *output_file, char *source
+  @description PRIVATE FUNCTION | Last compile time of source, measured in a batch or on its own, -1 if unknown
+  @returns double
+*/
+static double unity_member_seconds(const char *output_file, const char *source) {
+    char key[PATH_MAX + 8];
+    snprintf(key, sizeof(key), "unity:%s", source);
+    double seconds = get_recorded_duration(key);
+    if (seconds >= 0) return seconds;
+    object_path_for(key, sizeof(key), output_file, source);
+    return get_recorded_duration(key);
+}
+
+/*
+  @name unity_batch_size
+  @parameters char **sources, size_t count, char *output_file
+  @description PRIVATE FUNCTION | Enough batches to keep every job busy, but none expected to take longer than S_UNITY_BATCH_SECONDS
+  @returns size_t
+*/
+static size_t unity_batch_size(char **sources, size_t count, const char *output_file) {
+    if (S_UNITY_BATCH_SIZE > 0) return S_UNITY_BATCH_SIZE;
+
+    size_t jobs = (size_t)get_jobs();
+    size_t size = (count + jobs - 1) / jobs;
+
+    double total = 0;
+    size_t known = 0;
+    for (size_t i = 0; i < count; i++) {
+        double seconds = unity_member_seconds(output_file, sources[i]);
+        if (seconds < 0) continue;
+        total += seconds;
+        known++;
+    }
+    if (known > 0 && total > 0) {
+        double average = total / (double)known;
+        size_t limit = (size_t)(S_UNITY_BATCH_SECONDS / average);
+        if (size > limit) size = limit;
+    }
+
+    if (size < 1) size = 1;
+    if (size > S_UNITY_MAX_BATCH) size = S_UNITY_MAX_BATCH;
+    return size;
+}
+
+/*
+  @name write_unity_file
+  @parameters char *path, char **members, size_t num_members
+  @description PRIVATE FUNCTION | Writes the #include list of a batch, leaves the file alone when it did not change
+  @returns int
+*/
+static int write_unity_file(const char *path, char **members, size_t num_members) {
+    size_t length = 0, capacity = 256;
+    char *content = malloc(capacity);
+    if (!content) return S_ERROR;
+    content[0] = '\0';
+
+    for (size_t i = 0; i < num_members; i++) {
+        char resolved[PATH_MAX];
+        if (!realpath(members[i], resolved)) {
+            char cwd[PATH_MAX];
+            if (members[i][0] == '/' || !getcwd(cwd, sizeof(cwd))) snprintf(resolved, sizeof(resolved), "%s", members[i]);
+            else if (snprintf(resolved, sizeof(resolved), "%s/%s", cwd, members[i]) >= (int)sizeof(resolved)) {
+                free(content);
+                return S_ERROR;
+            }
+        }
+        size_t needed = length + strlen(resolved) * 2 + 16;
+        if (needed > capacity) {
+            while (capacity < needed) capacity *= 2;
+            char *temp = realloc(content, capacity);
+            if (!temp) {
+                free(content);
+                return S_ERROR;
+            }
+            content = temp;
+        }
+        length += (size_t)sprintf(content + length, "#include \"");
+        for (const char *c = resolved; *c; c++) {
+            if (*c == '"' || *c == '\\') content[length++] = '\\';
+            content[length++] = *c;
+        }
+        length += (size_t)sprintf(content + length, "\"\n");
+    }
+
+    size_t old_length;
+    char *old = read_file_contents(path, &old_length);
+    bool unchanged = old && old_length == length && memcmp(old, content, length) == 0;
+    free(old);
+
+    int result = 0;
+    if (!unchanged) {
+        FILE *file = fopen(path, "w");
+        if (!file || fwrite(content, 1, length, file) != length) result = S_ERROR;
+        if (file && fclose(file) != 0) result = S_ERROR;
+    }
+    free(content);
+    return result;
+}
+
+/*
+  @name plan_unity_batches
+  @parameters char **sources, int num_sources, char *output_file, size_t *num_batches, char **standalone, int *num_standalone
+  @description PRIVATE FUNCTION | Splits sources into unity batches under build_directory/unity and sources excluded with unity_exclude
+  @returns UnityBatch*
+*/
+static UnityBatch *plan_unity_batches(char **sources, int num_sources, const char *output_file, size_t *num_batches,
+                                      char **standalone, int *num_standalone) {
+    *num_batches = 0;
+    *num_standalone = 0;
+    // One allocation: the batches, then the batchable sources their members point into
+    UnityBatch *batches = calloc((size_t)num_sources, sizeof(UnityBatch) + sizeof(char *));
+    if (!batches) return NULL;
+    char **batchable = (char **)(batches + num_sources);
+
+    size_t count = 0;
+    for (int i = 0; i < num_sources; i++) {
+        char *source = sources[i]; // CONTAINS_STRING declares its own i
+        if (CONTAINS_STRING(unity_excluded, (int)num_unity_excluded, source)) standalone[(*num_standalone)++] = source;
+        else batchable[count++] = source;
+    }
+
+    // Batches are contiguous runs in source order so adding a file only disturbs its own batch and the ones after it
+    size_t size = count > 0 ? unity_batch_size(batchable, count, output_file) : 1;
+    for (size_t first = 0; first < count; first += size) {
+        UnityBatch *batch = &batches[*num_batches];
+        batch->members = batchable + first;
+        batch->num_members = count - first < size ? count - first : size;
+
+        if (batch->num_members == 1) {
+            standalone[(*num_standalone)++] = batch->members[0];
+            continue;
+        }
+        snprintf(batch->path, sizeof(batch->path), "%s/unity/%s/unity_%zu.c",
+                 build_directory ? build_directory : ".", output_file, *num_batches);
+        if (create_parent_directories(batch->path) != 0 ||
+            write_unity_file(batch->path, batch->members, batch->num_members) != 0) {
+            fprintf(stderr, "Error: Unable to write unity batch '%s'.\n", batch->path);
+            free(batches);
+            return NULL;
+        }
+        (*num_batches)++;
+    }
+    // Drop batches left over from a run that used more of them
+    for (size_t i = *num_batches;; i++) {
+        char stale[PATH_MAX];
+        snprintf(stale, sizeof(stale), "%s/unity/%s/unity_%zu.c", build_directory ? build_directory : ".", output_file, i);
+        if (unlink(stale) != 0) break;
+    }
+    verbose_log("Unity build of %s: %zu batches of up to %zu sources, %d compiled separately\n",
+                output_file, *num_batches, size, *num_standalone);
+    return batches;
+}
+
+/*
+  @name object_job
+  @parameters void *arg
+  @description PRIVATE FUNCTION | Job entry for compile_target, compiles one source to its object
+  @returns int
+*/
+static int object_job(void *arg) {
+    ObjectJob *job = arg;
+    char depfile[PATH_MAX + 8];
+    snprintf(depfile, sizeof(depfile), "%s.d", job->object);
+
+    if (create_parent_directories(job->object) != 0) {
+        fprintf(stderr, "Error: Unable to create directory for '%s'.\n", job->object);
+        return S_ERROR;
+    }
+
+    // Editors want the real sources, a batch is listed as its members
+    if (job->batch) {
+        for (size_t i = 0; i < job->batch->num_members; i++) {
+            Command member = {0};
+            for (size_t j = 0; j < job->command.count; j++) {
+                command_push(&member, strcmp(job->command.items[j], job->source) == 0 ? job->batch->members[i] : job->command.items[j]);
+            }
+            record_compile_command(job->batch->members[i], job->object, &member);
+            command_free(&member);
+        }
+    } else {
+        record_compile_command(job->source, job->object, &job->command);
+    }
+    if (run_build_step(job->source, job->object, &job->command, NULL, depfile, job->extra_inputs, job->num_extra_inputs,
+                       true, &job->rebuilt) != 0) {
+        fprintf(stderr, "Error: Compilation of '%s' failed.\n", job->source);
+        return S_ERROR;
+    }
+    if (job->rebuilt) printf("Compilation successful: %s\n", job->source);
+
+    // Split the batch time over its members so the next batch sizing knows what each costs
+    if (job->rebuilt && job->batch) {
+        double share = get_recorded_duration(job->object) / (double)job->batch->num_members;
+        for (size_t i = 0; i < job->batch->num_members; i++) {
+            char key[PATH_MAX + 8];
+            snprintf(key, sizeof(key), "unity:%s", job->batch->members[i]);
+            record_duration(key, share);
+        }
+    }
+    return 0;
+}
+
+/*
+  @name archive_objects
+  @parameters char *label, char *archive, char **objects, size_t num_objects, bool *archived
+  @description PRIVATE FUNCTION | Creates a static library | with the same member list as last time only the members newer than the archive are replaced
+  @returns int
+*/
+static int archive_objects(const char *label, const char *archive, char **objects, size_t num_objects, bool *archived) {
+    Command command = {0};
+    command_push_split(&command, lto_mode ? S_LTO_AR : S_AR);
+    command_push(&command, S_AR_MODE);
+    command_push(&command, archive);
+    for (size_t i = 0; i < num_objects; i++) command_push(&command, objects[i]);
+
+    char cmd_file[PATH_MAX + 8];
+    snprintf(cmd_file, sizeof(cmd_file), "%s.cmd", archive);
+    char *signature = command_render(&command);
+    *archived = false;
+    if (output_up_to_date(archive, cmd_file, signature, NULL, objects, num_objects)) {
+        verbose_log("Up to date: %s\n", label);
+        free(signature);
+        command_free(&command);
+        return 0;
+    }
+
+    // ar r replaces members in place, so only a changed member list (a source was removed) needs a fresh archive
+    char *previous = read_file_contents(cmd_file, NULL);
+    struct stat archive_stat;
+    bool same_members = previous && strcmp(previous, signature) == 0 && stat(archive, &archive_stat) == 0;
+    free(previous);
+    free(signature);
+
+    Command update = {0};
+    if (same_members) {
+        command_push_split(&update, lto_mode ? S_LTO_AR : S_AR);
+        command_push(&update, S_AR_MODE);
+        command_push(&update, archive);
+        size_t fixed = update.count;
+        for (size_t i = 0; i < num_objects; i++) {
+            struct stat object_stat;
+            if (stat(objects[i], &object_stat) != 0 || !is_newer(&archive_stat, &object_stat)) command_push(&update, objects[i]);
+        }
+        if (update.count == fixed) same_members = false;
+        else verbose_log("Replacing %zu of %zu members of %s\n", update.count - fixed, num_objects, archive);
+    }
+    if (!same_members) unlink(archive);
+
+    int result = run_build_step(label, archive, &command, same_members ? &update : NULL, NULL, objects, num_objects, false, archived);
+    command_free(&update);
+    command_free(&command);
+    return result;
+}
+
+/*
+  @name build_target
+  @parameters char **sources, int num_sources, char *output_file, bool create_shared, bool create_archive, PgoPhase *phase
+  @description PRIVATE FUNCTION | Shared by compile_target and compile_static_library | phase (may be NULL) adds the flags and profile inputs of a PGO build
+  @returns int
+*/
+static int build_target(char **sources, int num_sources, const char *output_file, bool create_shared, bool create_archive,
+                        const PgoPhase *phase) {
+    if (num_sources <= 0) {
+        fprintf(stderr, "Error: Target '%s' has no sources.\n", output_file);
+        return S_ERROR;
+    }
+    ensure_build_directory();
+
+    Command pch_use = {0};
+    PrecompiledHeader pch;
+    if (prepare_precompiled_header(&pch_use, create_shared, &pch) != 0) {
+        command_free(&pch_use);
+        return S_ERROR;
+    }
+
+    UnityBatch *batches = NULL;
+    size_t num_batches = 0;
+    char **units = NULL;
+    // PGO maps profiles object by object, batches could be cut differently in the instrumented and the final build
+    if (unity_build && num_sources > 1 && !phase) {
+        units = calloc((size_t)num_sources, sizeof(char *));
+        int num_standalone = 0;
+        batches = units ? plan_unity_batches(sources, num_sources, output_file, &num_batches, units, &num_standalone) : NULL;
+        if (!batches) {
+            free(units);
+            command_free(&pch_use);
+            return S_ERROR;
+        }
+        for (size_t i = 0; i < num_batches; i++) units[num_standalone + (int)i] = batches[i].path;
+        sources = units;
+        num_sources = num_standalone + (int)num_batches;
+    }
+
+    ObjectJob *objects = calloc((size_t)num_sources, sizeof(ObjectJob));
+    SambaJob *jobs = calloc((size_t)num_sources, sizeof(SambaJob));
+    char **object_paths = calloc((size_t)num_sources, sizeof(char *));
+    if (!objects || !jobs || !object_paths) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(objects);
+        free(jobs);
+        free(object_paths);
+        free(batches);
+        free(units);
+        command_free(&pch_use);
+        return S_ERROR;
+    }
+
+    for (int i = 0; i < num_sources; i++) {
+        ObjectJob *object = &objects[i];
+        object->source = sources[i];
+        object_path_for(object->object, sizeof(object->object), output_file, sources[i]);
+        object_paths[i] = object->object;
+        if (pch_use.count > 0) object->extra_inputs[object->num_extra_inputs++] = pch.output;
+        if (phase && phase->object_profiles) {
+            snprintf(object->profile, sizeof(object->profile), "%.*sgcda", (int)strlen(object->object) - 1, object->object);
+            object->extra_inputs[object->num_extra_inputs++] = object->profile;
+        } else if (phase && phase->profile[0]) {
+            object->extra_inputs[object->num_extra_inputs++] = (char *)phase->profile;
+        }
+        for (size_t j = 0; j < num_batches; j++) {
+            if (sources[i] == batches[j].path) object->batch = &batches[j];
+        }
+
+        Command *command = &object->command;
+        command_push_split(command, S_COMPILER);
+        append_compile_flags(command);
+        if (create_shared) command_push(command, "-fPIC");
+        if (phase) for (size_t j = 0; j < phase->flags.count; j++) command_push(command, phase->flags.items[j]);
+        for (size_t j = 0; j < pch_use.count; j++) command_push(command, pch_use.items[j]);
+        command_push(command, "-MMD");
+        command_push(command, "-MF");
+        command_pushf(command, "%s.d", object->object);
+        command_push(command, "-c");
+        command_push(command, "-o");
+        command_push(command, object->object);
+        command_push(command, sources[i]);
+
+        jobs[i].run = object_job;
+        jobs[i].arg = object;
+        // Every object feeds the same link, so the longest compile heads the longest chain
+        double estimate = object->batch ? estimate_duration(object->object, object->batch->members, object->batch->num_members)
+                                        : estimate_duration(object->object, &sources[i], 1);
+        jobs[i].priority = job_priority(estimate);
+    }
+
+    int result = run_jobs(jobs, (size_t)num_sources);
+
+    if (result == 0 && create_archive) {
+        char output_path[PATH_MAX];
+        if (build_directory == NULL) snprintf(output_path, sizeof(output_path), "%s", output_file);
+        else snprintf(output_path, sizeof(output_path), "%s/%s", build_directory, output_file);
+
+        bool archived;
+        result = archive_objects(output_file, output_path, object_paths, (size_t)num_sources, &archived);
+        if (result != 0) fprintf(stderr, "Error: Archiving '%s' failed.\n", output_file);
+        else if (archived) printf("Archiving successful: %s\n", output_file);
+    } else if (result == 0) {
+        char output_path[PATH_MAX];
+        if (build_directory == NULL) snprintf(output_path, sizeof(output_path), "%s", output_file);
+        else snprintf(output_path, sizeof(output_path), "%s/%s", build_directory, output_file);
+
+        Command command = {0};
+        command_push_split(&command, S_COMPILER);
+        for (size_t i = 0; i < num_flags; i++) {
+            if (!flags[i]) continue;
+            command_push(&command, flags[i]);
+        }
+        if (create_shared) command_push(&command, "-shared");
+        if (phase) for (size_t j = 0; j < phase->flags.count; j++) command_push(&command, phase->flags.items[j]);
+        append_lto_link_flags(&command);
+        command_push(&command, "-o");
+        command_push(&command, output_path);
+        for (int i = 0; i < num_sources; i++) {
+            command_push(&command, object_paths[i]);
+        }
+        append_link_libraries(&command);
+
+        // Objects and the libraries they link against, if none of them changed the link is skipped
+        Command inputs = {0};
+        for (int i = 0; i < num_sources; i++) command_push(&inputs, object_paths[i]);
+        append_library_files(&inputs);
+
+        bool linked;
+        Command run = {0};
+        bool lto = lto_link_run(&command, &run);
+        result = run_build_step(output_file, output_path, &command, lto ? &run : NULL, NULL, inputs.items, inputs.count, false, &linked);
+        command_free(&command);
+        command_free(&run);
+        command_free(&inputs);
+
+        if (result != 0) fprintf(stderr, "Error: Linking '%s' failed.\n", output_file);
+        else if (linked) printf("Linking successful: %s\n", output_file);
+    }
+
+    for (int i = 0; i < num_sources; i++) command_free(&objects[i].command);
+    command_free(&pch_use);
+    free(objects);
+    free(jobs);
+    free(object_paths);
+    free(batches);
+    free(units);
+    return result;
+}
+
+/*
+  @name pgo_profile_stale
+  @parameters char *manifest, char **sources, int num_sources
+  @description PRIVATE FUNCTION | True if there is no profile yet, the sources differ or too many of them changed since the training
+  @returns bool
+*/
+static bool pgo_profile_stale(const char *manifest, char **sources, int num_sources) {
+    char *contents = read_file_contents(manifest, NULL);
+    if (!contents) return true;
+
+    // One "hash source" line per source, in the order of the training
+    int changed = 0, listed = 0;
+    bool same_sources = true;
+    char *save = NULL;
+    for (char *line = strtok_r(contents, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        char *space = strchr(line, ' ');
+        if (!space || listed >= num_sources || strcmp(space + 1, sources[listed]) != 0) {
+            same_sources = false;
+            break;
         }
-    } while (choice != 5);
+        uint64_t hash;
+        if (hash_file(sources[listed], &hash) != 0 || strtoull(line, NULL, 16) != hash) changed++;
+        listed++;
+    }
+    free(contents);
+    if (!same_sources || listed != num_sources) {
+        verbose_log("Sources of the PGO profile changed, retraining.\n");
+        return true;
+    }
+    if ((double)changed > S_PGO_STALE_FRACTION * (double)num_sources) {
+        verbose_log("%d of %d sources changed since the PGO training, retraining.\n", changed, num_sources);
+        return true;
+    }
+    return false;
 }
 
 /*
-  @name add_memory_sanitizer
-  @parameters void
-  @description Adds memory sanitizer flags to the flags
-  @returns void
+  @name pgo_train
+  @parameters char **sources, int num_sources, char *output_file, bool create_shared, char *directory
+  @description PRIVATE FUNCTION | Phases 1 to 3: instrumented build in directory, training run, profile merge
+  @returns int
 */
-void add_memory_sanitizer() {
-    add_flag("-fsanitize=address");
-    add_flag("-fsanitize=undefined");
+static int pgo_train(char **sources, int num_sources, const char *output_file, bool create_shared, const char *directory) {
+    char instrumented[PATH_MAX + 16], binary[PATH_MAX + 32], raw[PATH_MAX + 8];
+    snprintf(instrumented, sizeof(instrumented), "pgo/%s/instrumented", output_file);
+    snprintf(binary, sizeof(binary), "%s/%s", build_directory ? build_directory : ".", instrumented);
+    snprintf(raw, sizeof(raw), "%s/raw", directory);
+
+    PgoPhase generate = {0};
+    #ifdef S_CMP_CLANG
+        command_pushf(&generate.flags, "-fprofile-generate=%s", raw);
+        run_args("rm", "-rf", raw, NULL);
+    #else
+        // Counters go next to each instrumented object and add up over runs, start from zero
+        command_push(&generate.flags, "-fprofile-generate");
+        for (int i = 0; i < num_sources; i++) {
+            char object[PATH_MAX], counters[PATH_MAX + 8];
+            object_path_for(object, sizeof(object), instrumented, sources[i]);
+            snprintf(counters, sizeof(counters), "%.*sgcda", (int)strlen(object) - 1, object);
+            unlink(counters);
+        }
+    #endif
+
+    printf("PGO: building instrumented %s\n", output_file);
+    create_parent_directories(binary);
+    int result = build_target(sources, num_sources, instrumented, create_shared, false, &generate);
+    command_free(&generate.flags);
+    if (result != 0) return S_ERROR;
+
+    char resolved[PATH_MAX + 32];
+    if (!realpath(binary, resolved)) snprintf(resolved, sizeof(resolved), "%s", binary);
+    setenv("SAMBA_PGO_BINARY", resolved, 1);
+    printf("PGO: training with '%s'\n", pgo_training);
+    result = run_args("sh", "-c", pgo_training, NULL);
+    unsetenv("SAMBA_PGO_BINARY");
+    if (result != 0) {
+        fprintf(stderr, "Error: PGO training of '%s' failed with status %d.\n", output_file, result);
+        return S_ERROR;
+    }
+
+    #ifdef S_CMP_CLANG
+        Command merge = {0};
+        command_push(&merge, "llvm-profdata");
+        command_push(&merge, "merge");
+        command_pushf(&merge, "-output=%s/default.profdata", directory);
+        DIR *dir = opendir(raw);
+        struct dirent *entry;
+        while (dir && (entry = readdir(dir)) != NULL) {
+            size_t length = strlen(entry->d_name);
+            if (length > 8 && strcmp(entry->d_name + length - 8, ".profraw") == 0) command_pushf(&merge, "%s/%s", raw, entry->d_name);
+        }
+        if (dir) closedir(dir);
+        result = merge.count > 3 ? run_process(&merge, NULL) : S_ERROR;
+        command_free(&merge);
+        if (result != 0) {
+            fprintf(stderr, "Error: No PGO profile for '%s', did the training run the instrumented binary?\n", output_file);
+            return S_ERROR;
+        }
+    #else
+        // gcc finds the counters next to the object it compiles, copy them to the objects of the real target
+        for (int i = 0; i < num_sources; i++) {
+            char object[PATH_MAX], from[PATH_MAX + 8], to[PATH_MAX + 8];
+            object_path_for(object, sizeof(object), instrumented, sources[i]);
+            snprintf(from, sizeof(from), "%.*sgcda", (int)strlen(object) - 1, object);
+            object_path_for(object, sizeof(object), output_file, sources[i]);
+            snprintf(to, sizeof(to), "%.*sgcda", (int)strlen(object) - 1, object);
+            create_parent_directories(to);
+            if (access(from, R_OK) != 0 || copy_file_contents(from, to) != 0) unlink(to);
+        }
+    #endif
+    return 0;
 }
 
 /*
-  @name add_compiler_warnings
-  @parameters void
-  @description Adds compiler warnings to the flags
-  @returns void
+  @name build_pgo_target
+  @parameters char **sources, int num_sources, char *output_file, bool create_shared
+  @description PRIVATE FUNCTION | compile_target with enable_pgo, trains only when the profile is missing or stale
+  @returns int
 */
-void add_compiler_warnings() {
-    add_flag("-Wall");
-    add_flag("-Wextra");
-    add_flag("-pedantic");
+static int build_pgo_target(char **sources, int num_sources, const char *output_file, bool create_shared) {
+    ensure_build_directory();
+    char directory[PATH_MAX], manifest[PATH_MAX + 16];
+    snprintf(directory, sizeof(directory), "%s/pgo/%s", build_directory ? build_directory : ".", output_file);
+    snprintf(manifest, sizeof(manifest), "%s/sources", directory);
+
+    if (pgo_profile_stale(manifest, sources, num_sources)) {
+        unlink(manifest);
+        create_parent_directories(manifest);
+        if (pgo_train(sources, num_sources, output_file, create_shared, directory) != 0) return S_ERROR;
+
+        FILE *file = fopen(manifest, "w");
+        for (int i = 0; file && i < num_sources; i++) {
+            uint64_t hash = 0;
+            hash_file(sources[i], &hash);
+            fprintf(file, "%016llx %s\n", (unsigned long long)hash, sources[i]);
+        }
+        if (!file || fclose(file) != 0) fprintf(stderr, "Warning: Unable to write '%s'.\n", manifest);
+    }
+
+    // Functions that changed since the training simply lose their profile
+    PgoPhase use = {0};
+    #ifdef S_CMP_CLANG
+        snprintf(use.profile, sizeof(use.profile), "%s/default.profdata", directory);
+        command_pushf(&use.flags, "-fprofile-use=%s", use.profile);
+        command_push(&use.flags, "-Wno-profile-instr-out-of-date");
+        command_push(&use.flags, "-Wno-profile-instr-unprofiled");
+    #else
+        use.object_profiles = true;
+        command_push(&use.flags, "-fprofile-use");
+        command_push(&use.flags, "-fprofile-partial-training");
+        command_push(&use.flags, "-Wno-coverage-mismatch");
+    #endif
+    int result = build_target(sources, num_sources, output_file, create_shared, false, &use);
+    command_free(&use.flags);
+    return result;
 }
 
 /*
-  @name send_notification
-  @parameters char *app_name, char *title, char *message
-  @description Sends a notification using the notify-send command
-  @returns void
+  @name compile_target
+  @parameters char **sources, int num_sources, char *output_file, bool create_shared
+  @description Compiles every source (or unity batch, see enable_unity_build) to its own object in build_directory/obj in parallel, then links output_file only if an object, a library in the library paths or the link command changed | with enable_pgo the target is built profile guided
+  @returns int
 */
-void send_notification(const char *app_name, const char *title, const char *message) {
-    char command[512];
-    snprintf(command, sizeof(command), "notify-send '%s' '%s' -a '%s'", title, message, app_name);
-    system(command);
+int compile_target(char **sources, int num_sources, const char *output_file, bool create_shared) {
+    if (pgo_training) return build_pgo_target(sources, num_sources, output_file, create_shared);
+    return build_target(sources, num_sources, output_file, create_shared, false, NULL);
 }
 
 /*
-  @name list_defined_variables
-  @parameters void
-  @description Prints all defined vars
-  @returns void
+  @name compile_static_library
+  @parameters char **sources, int num_sources, char *output_file
+  @description Like compile_target, but output_file becomes a static library (ar) | rebuilds only replace the changed members, S_THIN_ARCHIVE makes it a thin archive
+  @returns int
 */
-void list_defined_variables() {
-    printf("Defined Variables:\n");
-    for (size_t i = 0; i < num_variables; i++) {
-        printf(" - %s = %s\n", variables[i].key, variables[i].value);
-    }
+int compile_static_library(char **sources, int num_sources, const char *output_file) {
+    return build_target(sources, num_sources, output_file, false, true, NULL);
 }
 
+// -- Checkpoints --
+// INFO: checkpoint_backup stores every file of build_directory once in checkpoints_directory/.objects, named by both lanes of its content hash
+// INFO: A checkpoint is a tree of hardlinks into that store plus a manifest in checkpoints_directory/.manifests
+// INFO: Store objects are shared, so deleting a checkpoint only frees the objects no other checkpoint links to
+
+typedef struct {
+    char *path;      // relative to the root of the tree
+    uint64_t hash;
+    uint64_t mix;    // second hash lane, 0 in manifests written before it existed
+    long long size;
+    long long mtime; // nanoseconds, the next checkpoint does not rehash files whose size and mtime are unchanged
+    mode_t mode;
+} CheckpointEntry;
+
+typedef struct {
+    CheckpointEntry *items;
+    size_t count;
+    size_t capacity;
+} CheckpointManifest;
+
 /*
-  @name get_current_datetime
-  @parameters char *buffer, size_t buffer_size
-  @description Get current datetime and store it in the buffer
+  @name checkpoint_manifest_free
+  @parameters CheckpointManifest *manifest
+  @description PRIVATE FUNCTION | Frees the entries of a manifest
   @returns void
 */
-void get_current_datetime(char *buffer, size_t buffer_size) {
-    time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    strftime(buffer, buffer_size, "%Y-%m-%d %H:%M:%S", tm_info);
+static void checkpoint_manifest_free(CheckpointManifest *manifest) {
+    for (size_t i = 0; i < manifest->count; i++) free(manifest->items[i].path);
+    free(manifest->items);
+    memset(manifest, 0, sizeof(*manifest));
 }
 
 /*
-  @name is_internet_available
-  @parameters void
-  @description Checks if internet is available
-  @returns bool
+  @name checkpoint_manifest_add
+  @parameters CheckpointManifest *manifest, char *path
+  @description PRIVATE FUNCTION | Appends a zeroed entry for path
+  @returns CheckpointEntry *
 */
-bool is_internet_available() {
-    char buffer[256];
-    FILE *fp = popen("ping -c 1 8.8.8.8 > /dev/null 2>&1", "r");
-    if (fp == NULL) {
-        return false;
+static CheckpointEntry *checkpoint_manifest_add(CheckpointManifest *manifest, const char *path) {
+    if (manifest->count == manifest->capacity) {
+        size_t capacity = manifest->capacity ? manifest->capacity * 2 : 64;
+        CheckpointEntry *items = realloc(manifest->items, capacity * sizeof(CheckpointEntry));
+        if (!items) return NULL;
+        manifest->items = items;
+        manifest->capacity = capacity;
     }
-    fclose(fp);
-    return true;
+    CheckpointEntry *entry = &manifest->items[manifest->count];
+    memset(entry, 0, sizeof(*entry));
+    entry->path = strdup(path);
+    if (!entry->path) return NULL;
+    manifest->count++;
+    return entry;
 }
 
+/*
+  @name checkpoint_entry_compare
+  @parameters const void *a, const void *b
+  @description PRIVATE FUNCTION | Orders manifest entries by path for qsort and bsearch
+  @returns int
+*/
+static int checkpoint_entry_compare(const void *a, const void *b) {
+    return strcmp(((const CheckpointEntry *)a)->path, ((const CheckpointEntry *)b)->path);
+}
 
 /*
-  @name list_files_in_directory
-  @parameters char *dir_path
-  @description Print all files in a directory
+  @name checkpoint_manifest_path
+  @parameters char *buffer, size_t size, long checkpoint_num
+  @description PRIVATE FUNCTION | Path of the manifest of a checkpoint
   @returns void
 */
-void list_files_in_directory(const char *dir_path) {
-    struct dirent *entry;
-    DIR *dp = opendir(dir_path);
-    if (dp == NULL) {
-        perror("Error opening directory");
-        return;
-    }
+static void checkpoint_manifest_path(char *buffer, size_t size, long checkpoint_num) {
+    snprintf(buffer, size, "%s.manifests/%ld", checkpoints_directory, checkpoint_num);
+}
 
-    while ((entry = readdir(dp)) != NULL) {
-        printf("%s\n", entry->d_name);
+/*
+  @name checkpoint_manifest_load
+  @parameters long checkpoint_num, CheckpointManifest *manifest
+  @description PRIVATE FUNCTION | Reads the "hash size mtime mode path" lines of a checkpoint, sorted by path | hash is both lanes (32 digits), older manifests only have the first (16 digits)
+  @returns int
+*/
+static int checkpoint_manifest_load(long checkpoint_num, CheckpointManifest *manifest) {
+    char path[PATH_MAX];
+    checkpoint_manifest_path(path, sizeof(path), checkpoint_num);
+    char *contents = read_file_contents(path, NULL);
+    if (!contents) return S_ERROR;
+
+    char *save = NULL;
+    for (char *line = strtok_r(contents, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        char hash[33], lane[17];
+        long long size, mtime;
+        unsigned int mode;
+        int offset = 0;
+        if (sscanf(line, "%32[0-9a-f] %lld %lld %o %n", hash, &size, &mtime, &mode, &offset) != 4 || offset == 0) continue;
+        size_t digits = strlen(hash);
+        if (digits != 16 && digits != 32) continue;
+        CheckpointEntry *entry = checkpoint_manifest_add(manifest, line + offset);
+        if (!entry) break;
+        snprintf(lane, sizeof(lane), "%.16s", hash);
+        entry->hash = strtoull(lane, NULL, 16);
+        entry->mix = digits == 32 ? strtoull(hash + 16, NULL, 16) : 0;
+        entry->size = size;
+        entry->mtime = mtime;
+        entry->mode = (mode_t)mode;
     }
-
-    closedir(dp);
+    free(contents);
+    qsort(manifest->items, manifest->count, sizeof(CheckpointEntry), checkpoint_entry_compare);
+    return 0;
 }
 
-
 /*
-  @name get_process_id
-  @parameters void
-  @description Get the process ID of the current process
-  @returns pid_t
+  @name checkpoint_collect
+  @parameters char *root, char *relative, CheckpointManifest *manifest
+  @description PRIVATE FUNCTION | Adds every regular file below root/relative with its stat, hashes are filled in later
+  @returns int
 */
-pid_t get_process_id() {
-    return getpid();
-}
+static int checkpoint_collect(const char *root, const char *relative, CheckpointManifest *manifest) {
+    char directory[PATH_MAX];
+    snprintf(directory, sizeof(directory), "%s%s%s", root, relative[0] ? "/" : "", relative);
+    DIR *dir = opendir(directory);
+    if (!dir) return S_ERROR;
 
+    int result = 0;
+    struct dirent *entry;
+    while (result == 0 && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char path[PATH_MAX], full_path[PATH_MAX * 2];
+        snprintf(path, sizeof(path), "%s%s%s", relative, relative[0] ? "/" : "", entry->d_name);
+        snprintf(full_path, sizeof(full_path), "%s/%s", root, path);
+
+        struct stat st;
+        if (lstat(full_path, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            result = checkpoint_collect(root, path, manifest);
+        } else if (S_ISREG(st.st_mode)) {
+            CheckpointEntry *file = checkpoint_manifest_add(manifest, path);
+            if (!file) {
+                result = S_ERROR;
+                break;
+            }
+            file->size = (long long)st.st_size;
+            file->mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+            file->mode = st.st_mode & 07777;
+        } else {
+            verbose_log("Checkpoint skips '%s', it is not a regular file.\n", full_path);
+        }
+    }
+    closedir(dir);
+    return result;
+}
 
 /*
-  @name check_library
-  @parameters char *library
-  @description Checks if a library is installed using pkg-config
-  @returns bool
+  @name checkpoint_object_path
+  @parameters char *buffer, size_t size, CheckpointEntry *entry
+  @description PRIVATE FUNCTION | Store path of a file, the mode is part of the name since hardlinks share it
+  @returns void
 */
-bool check_library(const char *library) {
-    char command[256];
-    snprintf(command, sizeof(command), "pkg-config --exists %s > /dev/null 2>&1", library);
-    return (system(command) == 0);
+static void checkpoint_object_path(char *buffer, size_t size, const CheckpointEntry *entry) {
+    snprintf(buffer, size, "%s.objects/%02x/%014llx%016llx-%llx-%o", checkpoints_directory, (unsigned int)(entry->hash >> 56),
+             (unsigned long long)(entry->hash & 0xffffffffffffffULL), (unsigned long long)entry->mix,
+             (unsigned long long)entry->size, (unsigned int)entry->mode);
 }
 
 /*
-  @name add_no_debug
+  @name checkpoint_collect_garbage
   @parameters void
-  @description Sets the NDEBUG flag
+  @description PRIVATE FUNCTION | Removes store objects that no checkpoint links to anymore
   @returns void
 */
-void add_no_debug() {
-    add_flag("-DNDEBUG");
+static void checkpoint_collect_garbage() {
+    char store[PATH_MAX];
+    snprintf(store, sizeof(store), "%s.objects", checkpoints_directory);
+    DIR *dir = opendir(store);
+    if (!dir) return;
+
+    size_t removed = 0;
+    struct dirent *bucket;
+    while ((bucket = readdir(dir)) != NULL) {
+        if (bucket->d_name[0] == '.') continue;
+        char bucket_path[PATH_MAX + 256];
+        snprintf(bucket_path, sizeof(bucket_path), "%s/%s", store, bucket->d_name);
+        DIR *objects = opendir(bucket_path);
+        if (!objects) continue;
+        struct dirent *object;
+        while ((object = readdir(objects)) != NULL) {
+            if (object->d_name[0] == '.') continue;
+            char object_path[PATH_MAX + 512];
+            struct stat st;
+            snprintf(object_path, sizeof(object_path), "%s/%s", bucket_path, object->d_name);
+            // The only link left is the store's own
+            if (lstat(object_path, &st) == 0 && st.st_nlink <= 1 && unlink(object_path) == 0) removed++;
+        }
+        closedir(objects);
+        rmdir(bucket_path);
+    }
+    closedir(dir);
+    verbose_log("Removed %zu unreferenced checkpoint objects.\n", removed);
 }
 
-typedef struct {
-    char *target;
-    char *output;
-    bool create_shared;
-} compile_args_t;
+/*
+  @name clone_file
+  @parameters char *from, char *to, mode_t mode, long long mtime
+  @description PRIVATE FUNCTION | Copies a file as a reflink (FICLONE) where the filesystem supports it, else with copy_file_range, else read/write | to gets mode and mtime (nanoseconds) and is replaced atomically
+  @returns int, 0 or the errno of the step that failed (the cleanup would clobber errno itself)
+*/
+static int clone_file(const char *from, const char *to, mode_t mode, long long mtime) {
+    int in = open(from, O_RDONLY);
+    if (in < 0) return errno;
+
+    char temp_path[PATH_MAX + 64];
+    int needed = snprintf(temp_path, sizeof(temp_path), "%s.%ld.%lx.tmp", to, (long)getpid(), (unsigned long)pthread_self());
+    if (needed < 0 || (size_t)needed >= sizeof(temp_path)) {
+        close(in);
+        return ENAMETOOLONG;
+    }
+    int out = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (out < 0) {
+        int error = errno;
+        close(in);
+        return error;
+    }
 
-void *compile_wrapper(void *args) {
-    compile_args_t *compile_args = (compile_args_t *)args;
-    compile(compile_args->target, compile_args->output, compile_args->create_shared);
-    return NULL;
+    int result = 0;
+    bool cloned = false;
+    #ifdef FICLONE
+        cloned = ioctl(out, FICLONE, in) == 0;
+    #endif
+    if (!cloned) {
+        // Copies in the kernel, stops early on filesystems or kernels without support and read/write finishes the rest
+        #if defined __linux__ && defined SYS_copy_file_range
+            while (syscall(SYS_copy_file_range, in, NULL, out, NULL, (size_t)1 << 30, 0) > 0) {}
+        #endif
+        char buffer[65536];
+        ssize_t read_bytes;
+        while (result == 0 && (read_bytes = read(in, buffer, sizeof(buffer))) != 0) {
+            if (read_bytes < 0) {
+                if (errno == EINTR) continue;
+                result = errno;
+                break;
+            }
+            for (char *p = buffer; read_bytes > 0;) {
+                ssize_t written = write(out, p, (size_t)read_bytes);
+                if (written < 0) {
+                    if (errno == EINTR) continue;
+                    result = errno;
+                    break;
+                }
+                p += written;
+                read_bytes -= written;
+            }
+        }
+    }
+    close(in);
+
+    struct timespec times[2] = {{0, UTIME_OMIT}, {(time_t)(mtime / 1000000000LL), (long)(mtime % 1000000000LL)}};
+    if (result == 0 && (fchmod(out, mode) != 0 || futimens(out, times) != 0)) result = errno;
+    if (close(out) != 0 && result == 0) result = errno;
+    if (result == 0 && rename(temp_path, to) != 0) result = errno;
+    if (result != 0) unlink(temp_path);
+    return result;
 }
 
+typedef struct {
+    const char *from;
+    const char *to;
+    const CheckpointEntry *file;
+    bool hashed;  // file->hash is known, a destination with other stat but the same contents is kept
+    bool copied;
+} TreeCopyJob;
+
 /*
-  @name compile_parallel
-  @parameters char **targets, char **outputs, int num_targets
-  @description Compiles the targets in parallel (instead of define threads define num_targets)
+  @name tree_copy_job
+  @parameters void *arg
+  @description PRIVATE FUNCTION | Job entry for copy_tree, copies one file unless the destination already has its contents
   @returns int
 */
-int compile_parallel(char **targets, char **outputs, int num_targets) {
-    pthread_t thread_ids[num_targets];
-    for (int i = 0; i < num_targets; i++) {
-        compile_args_t *args = (compile_args_t *)malloc(sizeof(compile_args_t));
-        if (args == NULL) {
-            fprintf(stderr, "Memory allocation failed\n");
-            return S_ERROR;
-        }
-
-        args->target = targets[i];
-        args->output = outputs[i];
-        args->create_shared = false;
-
-        if (pthread_create(&thread_ids[i], NULL, compile_wrapper, (void *)args) != 0) {
-            fprintf(stderr, "Error: Unable to create thread\n");
-            free(args);
-            return S_ERROR;
+static int tree_copy_job(void *arg) {
+    TreeCopyJob *job = arg;
+    const CheckpointEntry *file = job->file;
+    char source[PATH_MAX * 2], destination[PATH_MAX * 2];
+    snprintf(source, sizeof(source), "%s/%s", job->from, file->path);
+    snprintf(destination, sizeof(destination), "%s/%s", job->to, file->path);
+
+    struct stat st;
+    if (lstat(destination, &st) == 0 && S_ISREG(st.st_mode) && (long long)st.st_size == file->size) {
+        long long mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        uint64_t hash, mix;
+        bool same = mtime == file->mtime || (job->hashed && hash_file_pair(destination, &hash, &mix) == 0 && hash == file->hash &&
+                                             (file->mix == 0 || mix == file->mix));
+        if (same) {
+            if ((st.st_mode & 07777) != file->mode) chmod(destination, file->mode);
+            if (mtime != file->mtime) {
+                struct timespec times[2] = {{0, UTIME_OMIT}, {(time_t)(file->mtime / 1000000000LL), (long)(file->mtime % 1000000000LL)}};
+                utimensat(AT_FDCWD, destination, times, 0);
+            }
+            return 0;
         }
     }
 
-    for (int i = 0; i < num_targets; i++) {
-        pthread_join(thread_ids[i], NULL);
+    create_parent_directories(destination);
+    int error = clone_file(source, destination, file->mode, file->mtime);
+    if (error != 0) {
+        fprintf(stderr, "Error: Unable to copy '%s' to '%s': %s\n", source, destination, strerror(error));
+        return S_ERROR;
     }
+    job->copied = true;
+    return 0;
+}
 
-
+/*
+  @name copy_tree
+  @parameters char *from, char *to, CheckpointManifest *files, bool hashed, size_t *copied
+  @description PRIVATE FUNCTION | Copies the files below from to to on get_jobs() threads, biggest first | files that to already has are skipped
+  @returns int
+*/
+static int copy_tree(const char *from, const char *to, const CheckpointManifest *files, bool hashed, size_t *copied) {
+    *copied = 0;
+    if (create_parent_directories(to) != 0 || (mkdir(to, 0755) != 0 && errno != EEXIST)) {
+        fprintf(stderr, "Error: Unable to create '%s': %s\n", to, strerror(errno));
+        return S_ERROR;
+    }
+    if (files->count == 0) return 0;
+
+    TreeCopyJob *copies = calloc(files->count, sizeof(TreeCopyJob));
+    SambaJob *jobs = calloc(files->count, sizeof(SambaJob));
+    if (!copies || !jobs) {
+        free(copies);
+        free(jobs);
+        fprintf(stderr, "Memory allocation failed\n");
+        return S_ERROR;
+    }
+    for (size_t i = 0; i < files->count; i++) {
+        copies[i] = (TreeCopyJob){from, to, &files->items[i], hashed, false};
+        jobs[i] = (SambaJob){tree_copy_job, &copies[i], (long)(files->items[i].size > LONG_MAX ? LONG_MAX : files->items[i].size), 0};
+    }
+    int result = run_jobs(jobs, files->count);
+    for (size_t i = 0; i < files->count; i++) *copied += copies[i].copied;
+    free(copies);
+    free(jobs);
+    return result;
 }
 
 long get_biggest_number_in_dir(const char* directory_path) {
@@ -1110,32 +5850,129 @@ long get_biggest_number_in_dir(const char* directory_path) {
 /*
   @name checkpoint_backup
   @parameters void
-  @description Copies compiled binaries to a checkpoint directory
+  @description Saves build_directory as the next checkpoint | unchanged files are hardlinked to the store objects earlier checkpoints already have, so only changed files are copied
   @returns void
 */
 void checkpoint_backup() {
-    char dir_name[32];
-    long next_num;
+    CheckpointManifest files = {0}, known = {0};
+    if (checkpoint_collect(build_directory, "", &files) != 0) {
+        fprintf(stderr, "Error: Unable to read build directory '%s'.\n", build_directory);
+        checkpoint_manifest_free(&files);
+        return;
+    }
 
-    next_num = get_biggest_number_in_dir(checkpoints_directory) + 1;
+    // The checkpoint directory only appears once there is something to put in it
+    long next_num = get_biggest_number_in_dir(checkpoints_directory) + 1;
+    char checkpoint_path[PATH_MAX];
+    snprintf(checkpoint_path, sizeof(checkpoint_path), "%s%ld", checkpoints_directory, next_num);
+    if (mkdir(checkpoint_path, 0755) != 0) {
+        fprintf(stderr, "Error: Unable to create checkpoint '%s': %s\n", checkpoint_path, strerror(errno));
+        checkpoint_manifest_free(&files);
+        return;
+    }
+
+    // Hashes are reused from the newest checkpoint that has a manifest, one that failed half way has none
+    for (long previous = next_num - 1; previous > 0; previous--) {
+        if (checkpoint_manifest_load(previous, &known) == 0) break;
+    }
 
-    snprintf(dir_name, sizeof(dir_name), "%ld", next_num);
+    size_t stored = 0, failed = 0;
+    for (size_t i = 0; i < files.count; i++) {
+        CheckpointEntry *file = &files.items[i];
+        char source[PATH_MAX * 2], object[PATH_MAX], link_path[PATH_MAX * 2];
+        snprintf(source, sizeof(source), "%s/%s", build_directory, file->path);
+        snprintf(link_path, sizeof(link_path), "%s/%s", checkpoint_path, file->path);
+
+        CheckpointEntry *seen = bsearch(file, known.items, known.count, sizeof(CheckpointEntry), checkpoint_entry_compare);
+        if (seen && seen->mix != 0 && seen->size == file->size && seen->mtime == file->mtime && seen->mode == file->mode) {
+            file->hash = seen->hash;
+            file->mix = seen->mix;
+        } else if (hash_file_pair(source, &file->hash, &file->mix) != 0) {
+            failed++;
+            continue;
+        }
+
+        checkpoint_object_path(object, sizeof(object), file);
+        if (access(object, F_OK) != 0) {
+            create_parent_directories(object);
+            if (clone_file(source, object, file->mode, file->mtime) != 0) {
+                failed++;
+                continue;
+            }
+            stored++;
+        }
+        create_parent_directories(link_path);
+        if (link(object, link_path) != 0 && clone_file(object, link_path, file->mode, file->mtime) != 0) failed++;
+    }
 
-    if (dir_name[0] != '\0') {
-        s_command("mkdir -p %s%s", checkpoints_directory, dir_name);
-        s_command("cp -r %s/* %s%s/", build_directory, checkpoints_directory, dir_name);
+    // Files that failed stay out of the manifest, restoring then keeps what the build directory has
+    char manifest_path[PATH_MAX], temp_path[PATH_MAX + 8];
+    checkpoint_manifest_path(manifest_path, sizeof(manifest_path), next_num);
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", manifest_path);
+    create_parent_directories(manifest_path);
+    FILE *manifest = fopen(temp_path, "w");
+    for (size_t i = 0; manifest && i < files.count; i++) {
+        const CheckpointEntry *file = &files.items[i];
+        char link_path[PATH_MAX * 2];
+        snprintf(link_path, sizeof(link_path), "%s/%s", checkpoint_path, file->path);
+        if (access(link_path, F_OK) != 0) continue;
+        fprintf(manifest, "%016llx%016llx %lld %lld %o %s\n", (unsigned long long)file->hash, (unsigned long long)file->mix,
+                file->size, file->mtime, (unsigned int)file->mode, file->path);
     }
+    if (!manifest || fclose(manifest) != 0 || rename(temp_path, manifest_path) != 0) {
+        fprintf(stderr, "Error: Unable to write checkpoint manifest '%s'.\n", manifest_path);
+        unlink(temp_path);
+    }
+
+    if (failed > 0) fprintf(stderr, "Error: %zu files could not be saved in checkpoint %ld.\n", failed, next_num);
+    verbose_log("Checkpoint %ld: %zu files, %zu new in the store.\n", next_num, files.count, stored);
+    checkpoint_manifest_free(&files);
+    checkpoint_manifest_free(&known);
 }
 
+/*
+  @name restore_checkpoint
+  @parameters long checkpoint_num
+  @description Copies a checkpoint back into build_directory on get_jobs() threads, files the build directory already has are left alone | restored files keep the mtime they had when the checkpoint was taken
+  @returns void
+*/
 void restore_checkpoint(long checkpoint_num) {
-    char dir_name[32];
-    snprintf(dir_name, sizeof(dir_name), "%ld", checkpoint_num);
+    char source[PATH_MAX];
+    snprintf(source, sizeof(source), "%s%ld", checkpoints_directory, checkpoint_num);
+
+    // Checkpoints from before the store have no manifest, their tree is compared by stat only
+    CheckpointManifest files = {0};
+    bool hashed = checkpoint_manifest_load(checkpoint_num, &files) == 0;
+    if (!hashed && checkpoint_collect(source, "", &files) != 0) {
+        fprintf(stderr, "Error: Checkpoint %ld does not exist.\n", checkpoint_num);
+        checkpoint_manifest_free(&files);
+        return;
+    }
 
-    if (access(build_directory, F_OK) != 0) {
-        s_command("mkdir -p %s", build_directory);
+    size_t copied = 0;
+    if (copy_tree(source, build_directory, &files, hashed, &copied) != 0) {
+        fprintf(stderr, "Error: Checkpoint %ld was only partly restored.\n", checkpoint_num);
     }
+    verbose_log("Restored %zu of %zu files from checkpoint %ld.\n", copied, files.count, checkpoint_num);
+    checkpoint_manifest_free(&files);
+}
 
-    s_command("cp -r %s%s/* %s/", checkpoints_directory, dir_name, build_directory);
+/*
+  @name backup_build_directory
+  @parameters char *backup_dir
+  @description Copies the contents of build_directory into backup_dir on get_jobs() threads | files backup_dir already has with the same size and mtime are skipped
+  @returns void
+*/
+void backup_build_directory(const char *backup_dir) {
+    CheckpointManifest files = {0};
+    size_t copied = 0;
+    if (checkpoint_collect(build_directory, "", &files) != 0) {
+        fprintf(stderr, "Error: Unable to read build directory '%s'.\n", build_directory);
+    } else if (copy_tree(build_directory, backup_dir, &files, false, &copied) != 0) {
+        fprintf(stderr, "Error: Backup to '%s' is incomplete.\n", backup_dir);
+    }
+    verbose_log("Backed up %zu of %zu files to '%s'.\n", copied, files.count, backup_dir);
+    checkpoint_manifest_free(&files);
 }
 
 void list_checkpoints() {
@@ -1160,7 +5997,14 @@ void list_checkpoints() {
 void delete_checkpoint(long checkpoint_num) {
     char dir_name[32];
     snprintf(dir_name, sizeof(dir_name), "%ld", checkpoint_num);
-    s_command("rm -rf %s%s", checkpoints_directory, dir_name);
+    char checkpoint_path[PATH_MAX];
+    snprintf(checkpoint_path, sizeof(checkpoint_path), "%s%s", checkpoints_directory, dir_name);
+    run_args("rm", "-rf", checkpoint_path, NULL);
+
+    char manifest_path[PATH_MAX];
+    checkpoint_manifest_path(manifest_path, sizeof(manifest_path), checkpoint_num);
+    unlink(manifest_path);
+    checkpoint_collect_garbage();
 }
 
 bool checkpoint_exists(long checkpoint_num) {
@@ -1170,7 +6014,21 @@ bool checkpoint_exists(long checkpoint_num) {
 }
 
 void delete_all_checkpoints() {
-    s_command("rm -rf %s*", checkpoints_directory);
+    DIR *dir = opendir(checkpoints_directory);
+    if (dir == NULL) return;
+
+    Command command = {0};
+    command_push(&command, "rm");
+    command_push(&command, "-rf");
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        command_pushf(&command, "%s%s", checkpoints_directory, entry->d_name);
+    }
+    closedir(dir);
+
+    if (command.count > 2) run_process(&command, NULL);
+    command_free(&command);
 }
 
 int directory_contains(const char *path, const char *filename) {
@@ -1199,13 +6057,9 @@ bool is_file_writable(const char *path) {
 
 void install_dependency(char *tool) {
     if (check_tool("dnf")) {
-        char command[256];
-        snprintf(command, sizeof(command), "sudo dnf install -y %s", tool);
-        system(command);
+        run_args("sudo", "dnf", "install", "-y", tool, NULL);
     } else if (check_tool("apt-get")) {
-        char command[256];
-        snprintf(command, sizeof(command), "sudo apt-get install -y %s", tool);
-        system(command);
+        run_args("sudo", "apt-get", "install", "-y", tool, NULL);
     } else {
         fprintf(stderr, "Error: Package manager not found. Please install '%s' manually.\n", tool);
     }
@@ -1263,6 +6117,110 @@ char *get_git_hash() {
 
 
 
+// -- Builtins --
+// INFO: Functions callable from build.samba, one table sorted by name and searched with bsearch
+typedef int (*builtin_ft)(int argc, char **argv);
+
+typedef struct {
+    const char *name;
+    int arity;
+    builtin_ft handler;
+} Builtin;
+
+// INFO: arity >= 0 takes exactly that many arguments, S_AT_LEAST(n) takes n or more
+#define S_AT_LEAST(n) (-1 - (n))
+#define S_UNUSED __attribute__((unused)) // for handler parameters a builtin ignores
+
+Builtin *builtins = NULL;
+size_t num_builtins = 0;
+size_t builtins_capacity = 0;
+
+/*
+  @name builtin_compare
+  @parameters const void *a, const void *b
+  @description PRIVATE FUNCTION | Orders builtins by name for qsort and bsearch
+  @returns int
+*/
+static int builtin_compare(const void *a, const void *b) {
+    return strcmp(((const Builtin *)a)->name, ((const Builtin *)b)->name);
+}
+
+/*
+  @name find_builtin
+  @parameters const char *name
+  @description Looks up a builtin by name, NULL if there is none
+  @returns const Builtin *
+*/
+const Builtin *find_builtin(const char *name) {
+    if (!name || num_builtins == 0) return NULL;
+    Builtin key = { name, 0, NULL };
+    return bsearch(&key, builtins, num_builtins, sizeof(Builtin), builtin_compare);
+}
+
+/*
+  @name register_builtins
+  @parameters const Builtin *table
+  @description Adds every entry of a table ending in { NULL } to the builtins, a name that already exists is replaced
+  @returns int
+*/
+int register_builtins(const Builtin *table) {
+    if (!table) return S_ERROR;
+    size_t added = 0;
+    while (table[added].name) added++;
+    if (num_builtins + added > builtins_capacity) {
+        size_t capacity = builtins_capacity ? builtins_capacity : 64;
+        while (capacity < num_builtins + added) capacity *= 2;
+        Builtin *grown = realloc(builtins, capacity * sizeof(Builtin));
+        if (!grown) {
+            fprintf(stderr, "Error: Memory allocation failed for builtins.\n");
+            return S_ERROR;
+        }
+        builtins = grown;
+        builtins_capacity = capacity;
+    }
+    for (size_t i = 0; i < added; i++) {
+        if (!table[i].handler) continue;
+        Builtin *existing = (Builtin *)find_builtin(table[i].name);
+        if (existing) {
+            verbose_log("Builtin '%s' replaced.\n", table[i].name);
+            *existing = table[i];
+            continue;
+        }
+        // Insert in place, the table stays sorted for bsearch
+        size_t low = 0, high = num_builtins;
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (strcmp(builtins[middle].name, table[i].name) < 0) low = middle + 1;
+            else high = middle;
+        }
+        memmove(builtins + low + 1, builtins + low, (num_builtins - low) * sizeof(Builtin));
+        builtins[low] = table[i];
+        num_builtins++;
+    }
+    return 0;
+}
+
+/*
+  @name register_builtin
+  @parameters const char *name, int arity, builtin_ft handler
+  @description Adds one builtin, e.g. register_builtin("hello", 1, hello) makes hello("world") work in build.samba
+  @returns int
+*/
+int register_builtin(const char *name, int arity, builtin_ft handler) {
+    Builtin table[2] = { { name, arity, handler }, { NULL, 0, NULL } };
+    return register_builtins(table);
+}
+
+/*
+  @name builtin_accepts
+  @parameters const Builtin *builtin, int argc
+  @description Checks argc against the arity of the builtin
+  @returns bool
+*/
+bool builtin_accepts(const Builtin *builtin, int argc) {
+    return builtin->arity < 0 ? argc >= -1 - builtin->arity : argc == builtin->arity;
+}
+
 typedef struct {
     char *plugin_name;
     char *plugin_file;
@@ -1285,6 +6243,12 @@ void *plugin_connect(Plugin *plugin) {
         return NULL;
     }
 
+    // Optional: a plugin exporting "const Builtin p_builtins[]" (ending in { NULL }) extends build.samba
+    const Builtin *plugin_builtins = (const Builtin *)dlsym(opened, "p_builtins");
+    if (plugin_builtins && register_builtins(plugin_builtins) != 0) {
+        fprintf(stderr, "Error: Plugin '%s' builtins could not be registered.\n", plugin->plugin_name);
+    }
+
     return opened;
 }
 
@@ -1344,6 +6308,7 @@ int plugin_shutdown(void *dlopen_) {
 void print_flags() {
     printf("Flags:\n");
     for (size_t i = 0; i < num_flags; i++) {
+        if (!flags[i]) continue;
         printf(" - %s\n", flags[i]);
     }
 }
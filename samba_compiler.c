@@ -14,6 +14,7 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include <time.h>
+#include <sys/mman.h>
 
 #include "samba.h"
 
@@ -237,186 +238,890 @@ void convert_samba_to_makefile(const char* samba_file, const char* makefile_name
 
 
 
-void execute_function(const char* func_name, StringArray* args) {
+// -- Builtins --
+// INFO: One handler per build.samba function, samba_builtins is kept sorted by name (register_builtins sorts anyway)
+int builtin_add_compiler_warnings(S_UNUSED int argc, S_UNUSED char** argv) { add_compiler_warnings(); return 0; }
+int builtin_add_flag(S_UNUSED int argc, char** argv) { add_flag(argv[0]); return 0; }
+int builtin_add_memory_sanitizer(S_UNUSED int argc, S_UNUSED char** argv) { add_memory_sanitizer(); return 0; }
+int builtin_backup_build_directory(S_UNUSED int argc, char** argv) { backup_build_directory(argv[0]); return 0; }
+int builtin_check_and_install_dependency(S_UNUSED int argc, char** argv) { check_and_install_dependency(argv[0]); return 0; }
+int builtin_check_tool(S_UNUSED int argc, char** argv) { check_tool(argv[0]); return 0; }
+int builtin_clear_build_directory(S_UNUSED int argc, S_UNUSED char** argv) { clear_build_directory(); return 0; }
+int builtin_compile(S_UNUSED int argc, char** argv) { return compile(argv[0], argv[1], false); }
+int builtin_compile_s(S_UNUSED int argc, char** argv) { return compile(argv[0], argv[1], true); }
+int builtin_compile_static_library(int argc, char** argv) { return compile_static_library(argv + 1, argc - 1, argv[0]); }
+int builtin_compile_target(int argc, char** argv) { return compile_target(argv + 1, argc - 1, argv[0], false); }
+int builtin_compile_target_s(int argc, char** argv) { return compile_target(argv + 1, argc - 1, argv[0], true); }
+int builtin_convert_to_make(S_UNUSED int argc, S_UNUSED char** argv) { convert_samba_to_makefile("build.samba", "Makefile"); return 0; }
+int builtin_define_include(S_UNUSED int argc, char** argv) { define_include(argv[0]); return 0; }
+int builtin_define_library(S_UNUSED int argc, char** argv) { define_library(argv[0]); return 0; }
+int builtin_define_library_path(S_UNUSED int argc, char** argv) { define_library_path(argv[0]); return 0; }
+int builtin_define_precompiled_header(S_UNUSED int argc, char** argv) { define_precompiled_header(argv[0]); return 0; }
+int builtin_define_variable(S_UNUSED int argc, char** argv) { define_variable(argv[0], argv[1]); return 0; }
+int builtin_enable_compilation_cache(S_UNUSED int argc, S_UNUSED char** argv) { enable_compilation_cache(); return 0; }
+int builtin_enable_compile_commands(S_UNUSED int argc, S_UNUSED char** argv) { enable_compile_commands(); return 0; }
+int builtin_enable_lto(S_UNUSED int argc, S_UNUSED char** argv) { enable_lto(); return 0; }
+int builtin_enable_pgo(S_UNUSED int argc, char** argv) { return enable_pgo(argv[0]); }
+int builtin_enable_unity_build(S_UNUSED int argc, S_UNUSED char** argv) { enable_unity_build(); return 0; }
+// verbose_mode and S_COMPILER are fixed when samba is compiled (S_VERBOSE_MODE, S_CMP_CLANG), these only keep old build files parsing
+int builtin_enable_verbose(S_UNUSED int argc, S_UNUSED char** argv) { return 0; }
+int builtin_eprintfn(S_UNUSED int argc, char** argv) { fprintf(stderr, "\033[0;31m%s\033[0m\n", argv[0]); return 0; }
+int builtin_exit(S_UNUSED int argc, char** argv) { exit(atoi(argv[0])); return 0; }
+int builtin_file_exists(S_UNUSED int argc, char** argv) { file_exists(argv[0]); return 0; }
+int builtin_find_flags(S_UNUSED int argc, char** argv) { find_flags(argv[0]); return 0; }
+int builtin_find_library(S_UNUSED int argc, char** argv) { find_library(argv[0]); return 0; }
+int builtin_generate_build_report_to_file(S_UNUSED int argc, char** argv) { generate_build_report_to_file(argv[0]); return 0; }
+int builtin_generate_timestamp_file(S_UNUSED int argc, S_UNUSED char** argv) { generate_timestamp_file(); return 0; }
+int builtin_install_dependency(S_UNUSED int argc, char** argv) { install_dependency(argv[0]); return 0; }
+int builtin_list_defined_variables(S_UNUSED int argc, S_UNUSED char** argv) { list_defined_variables(); return 0; }
+int builtin_list_files_in_directory(S_UNUSED int argc, char** argv) { list_files_in_directory(argv[0]); return 0; }
+int builtin_print_flags(S_UNUSED int argc, S_UNUSED char** argv) { print_flags(); return 0; }
+int builtin_print_libraries(S_UNUSED int argc, S_UNUSED char** argv) { print_libraries(); return 0; }
+int builtin_printfn(S_UNUSED int argc, char** argv) { printf("%s\n", argv[0]); return 0; }
+int builtin_remove_flag(S_UNUSED int argc, char** argv) { remove_flag(argv[0]); return 0; }
+int builtin_remove_variable(S_UNUSED int argc, char** argv) { remove_variable(argv[0]); return 0; }
+int builtin_reset_settings(S_UNUSED int argc, S_UNUSED char** argv) { reset_settings(); return 0; }
+int builtin_s_command(S_UNUSED int argc, char** argv) { s_command(argv[0]); return 0; }
+int builtin_send_notification(S_UNUSED int argc, char** argv) { send_notification(argv[0], argv[1], argv[2]); return 0; }
+int builtin_set_build_directory(S_UNUSED int argc, char** argv) { set_build_directory(argv[0]); return 0; }
+int builtin_set_cache_directory(S_UNUSED int argc, char** argv) { set_cache_directory(argv[0]); return 0; }
+int builtin_set_cache_size_limit(S_UNUSED int argc, char** argv) { set_cache_size_limit(strtoull(argv[0], NULL, 10)); return 0; }
+int builtin_unity_exclude(S_UNUSED int argc, char** argv) { unity_exclude(argv[0]); return 0; }
+int builtin_use_package(S_UNUSED int argc, char** argv) { return use_package(argv[0]); }
+int builtin_win_compiler(S_UNUSED int argc, S_UNUSED char** argv) { return 0; }
+
+const Builtin samba_builtins[] = {
+    { "add_compiler_warnings",         0,              builtin_add_compiler_warnings },
+    { "add_flag",                      1,              builtin_add_flag },
+    { "add_memory_sanitizer",          0,              builtin_add_memory_sanitizer },
+    { "backup_build_directory",        1,              builtin_backup_build_directory },
+    { "check_and_install_dependency",  1,              builtin_check_and_install_dependency },
+    { "check_tool",                    1,              builtin_check_tool },
+    { "clear_build_directory",         0,              builtin_clear_build_directory },
+    { "compile",                       2,              builtin_compile },
+    { "compile_s",                     2,              builtin_compile_s },
+    { "compile_static_library",        S_AT_LEAST(2),  builtin_compile_static_library },
+    { "compile_target",                S_AT_LEAST(2),  builtin_compile_target },
+    { "compile_target_s",              S_AT_LEAST(2),  builtin_compile_target_s },
+    { "convert_to_make",               0,              builtin_convert_to_make },
+    { "define_include",                1,              builtin_define_include },
+    { "define_library",                1,              builtin_define_library },
+    { "define_library_path",           1,              builtin_define_library_path },
+    { "define_precompiled_header",     1,              builtin_define_precompiled_header },
+    { "define_variable",               2,              builtin_define_variable },
+    { "enable_compilation_cache",      0,              builtin_enable_compilation_cache },
+    { "enable_compile_commands",       0,              builtin_enable_compile_commands },
+    { "enable_lto",                    0,              builtin_enable_lto },
+    { "enable_pgo",                    1,              builtin_enable_pgo },
+    { "enable_unity_build",            0,              builtin_enable_unity_build },
+    { "enable_verbose",                0,              builtin_enable_verbose },
+    { "eprintfn",                      1,              builtin_eprintfn },
+    { "exit",                          1,              builtin_exit },
+    { "file_exists",                   1,              builtin_file_exists },
+    { "find_flags",                    1,              builtin_find_flags },
+    { "find_library",                  1,              builtin_find_library },
+    { "generate_build_report_to_file", 1,              builtin_generate_build_report_to_file },
+    { "generate_timestamp_file",       0,              builtin_generate_timestamp_file },
+    { "install_dependency",            1,              builtin_install_dependency },
+    { "list_defined_variables",        0,              builtin_list_defined_variables },
+    { "list_files_in_directory",       1,              builtin_list_files_in_directory },
+    { "print_flags",                   0,              builtin_print_flags },
+    { "print_libraries",               0,              builtin_print_libraries },
+    { "printfn",                       1,              builtin_printfn },
+    { "remove_flag",                   1,              builtin_remove_flag },
+    { "remove_variable",               1,              builtin_remove_variable },
+    { "reset_settings",                0,              builtin_reset_settings },
+    { "s_command",                     1,              builtin_s_command },
+    { "send_notification",             3,              builtin_send_notification },
+    { "set_build_directory",           1,              builtin_set_build_directory },
+    { "set_cache_directory",           1,              builtin_set_cache_directory },
+    { "set_cache_size_limit",          1,              builtin_set_cache_size_limit },
+    { "unity_exclude",                 1,              builtin_unity_exclude },
+    { "use_package",                   1,              builtin_use_package },
+    { "win_compiler",                  0,              builtin_win_compiler },
+    { NULL, 0, NULL }
+};
+
+int execute_function(const char* func_name, StringArray* args) {
     if (!func_name || !args) {
         fprintf(stderr, "Invalid function name or arguments.\n");
-        return;
+        return S_ERROR;
     }
-    if (strcmp(func_name, "define_variable") == 0 && args->size == 2) {
-        define_variable(args->data[0], args->data[1]);
-    } else if (strcmp(func_name, "define_library") == 0 && args->size == 1) {
-        define_library(args->data[0]);
-    } else if (strcmp(func_name, "define_include") == 0 && args->size == 1) {
-        define_include(args->data[0]);
-    } else if (strcmp(func_name, "define_library_path") == 0 && args->size == 1) {
-        define_library_path(args->data[0]);
-    } else if (strcmp(func_name, "add_flag") == 0 && args->size == 1) {
-        add_flag(args->data[0]);
-    } else if (strcmp(func_name, "compile") == 0 && args->size == 2) {
-        compile(args->data[0], args->data[1], false);
-    } else if (strcmp(func_name, "compile_s") == 0 && args->size == 2) {
-        compile(args->data[0], args->data[1], true);
-    } else if (strcmp(func_name, "enable_verbose") == 0 && args->size == 0) {
-        #undef verbose_mode
-        #define verbose_mode
-    } else if (strcmp(func_name, "win_compiler") == 0 && args->size == 0) {
-        #undef S_COMPILER
-        #define S_COMPILER "x86_64-w64-mingw32-gcc"
-    } else if (strcmp(func_name, "printfn") == 0 && args->size == 1) {
-        printf("%s\n", args->data[0]);
-    } else if (strcmp(func_name, "check_tool") == 0 && args->size == 1) {
-        check_tool(args->data[0]);
-    } else if (strcmp(func_name, "reset_settings") == 0 && args->size == 0) {
-        reset_settings();
-    } else if (strcmp(func_name, "file_exists") == 0 && args->size == 1) {
-        file_exists(args->data[0]);
-    } else if (strcmp(func_name, "find_library") == 0 && args->size == 1) {
-        find_library(args->data[0]);
-    } else if (strcmp(func_name, "find_flags") == 0 && args->size == 1) {
-        find_flags(args->data[0]);
-    } else if (strcmp(func_name, "s_command") == 0 && args->size == 1) {
-        s_command(args->data[0]);
-    } else if (strcmp(func_name, "set_build_directory") == 0 && args->size == 1) {
-        set_build_directory(args->data[0]);
-    } else if (strcmp(func_name, "print_libraries") == 0 && args->size == 0) {
-        print_libraries();
-    } else if (strcmp(func_name, "clear_build_directory") == 0 && args->size == 0) {
-        clear_build_directory();
-    } else if (strcmp(func_name, "generate_build_report_to_file") == 0 && args->size == 1) {
-        generate_build_report_to_file(args->data[0]);
-    } else if (strcmp(func_name, "generate_timestamp_file") == 0 && args->size == 0) {
-        generate_timestamp_file();
-    } else if (strcmp(func_name, "backup_build_directory") == 0 && args->size == 1) {
-        backup_build_directory(args->data[0]);
-    } else if (strcmp(func_name, "check_and_install_dependency") == 0 && args->size == 1) {
-        check_and_install_dependency(args->data[0]);
-    } else if (strcmp(func_name, "add_memory_sanitizer") == 0 && args->size == 0) {
-        add_memory_sanitizer();
-    } else if (strcmp(func_name, "add_compiler_warnings") == 0 && args->size == 0) {
-        add_compiler_warnings();
-    } else if (strcmp(func_name, "send_notification") == 0 && args->size == 3) {
-        send_notification(args->data[0], args->data[1], args->data[2]);
-    } else if (strcmp(func_name, "list_defined_variables") == 0 && args->size == 0) {
-        list_defined_variables();
-    } else if (strcmp(func_name, "list_files_in_directory") == 0 && args->size == 1) {
-        list_files_in_directory(args->data[0]);
-    } else if (strcmp(func_name, "install_dependency") == 0 && args->size == 1) {
-        install_dependency(args->data[0]);
-    } else if (strcmp(func_name, "exit") == 0 && args->size == 1) {
-        exit(atoi(args->data[0]));
-    } else if (strcmp(func_name, "eprintfn") == 0 && args->size == 1) {
-        fprintf(stderr, "\033[0;31m%s\033[0m\n", args->data[0]);
-    } else if (strcmp(func_name, "remove_variable") == 0 && args->size == 1) {
-        remove_variable(args->data[0]);
-    } else if (strcmp(func_name, "remove_flag") == 0 && args->size == 1) {
-        remove_flag(args->data[0]);
-    } else if (strcmp(func_name, "print_flags") == 0 && args->size == 0) {
-        print_flags();
-    } else if (strcmp(func_name, "convert_to_make") == 0 && args->size == 0) {
-        convert_samba_to_makefile("build.samba", "Makefile");
-    } else {
+    const Builtin* builtin = find_builtin(func_name);
+    if (!builtin || !builtin_accepts(builtin, (int)args->size)) {
         fprintf(stderr, "Unknown function or invalid arguments: %s\n", func_name);
+        return S_ERROR;
     }
+    return builtin->handler((int)args->size, args->data);
 }
 
-void parse_build_file(const char* filename, int argc, char **argv_, bool program_arg_mode) {
-    if (!filename) {
-        fprintf(stderr, "Invalid filename.\n");
-        return;
+// -- Build Program --
+// INFO: build.samba compiled to opcodes over an interned string table, cached as .<file>.ir next to it and mmap'd
+//       again while the source hash is unchanged
+#define IR_MAGIC "SAMBAIR2"
+
+enum { OP_TARGET, OP_DEPEND, OP_CALL, OP_ARG }; // OP_CALL a = function, b = number of OP_ARG that follow
+
+typedef struct {
+    uint32_t opcode;
+    uint32_t a; // string id
+    uint32_t b;
+} Instruction;
+
+typedef struct {
+    char magic[8];
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint32_t num_instructions;
+    uint32_t num_strings;
+    uint32_t string_bytes;
+    uint32_t reserved;
+} IrHeader; // followed by Instruction[num_instructions], uint32_t offsets[num_strings], char strings[string_bytes]
+
+typedef struct {
+    void* memory;
+    size_t size;
+    bool mapped;
+    const Instruction* code;
+    uint32_t num_instructions;
+    const uint32_t* offsets;
+    uint32_t num_strings;
+    char* strings; // writable, builtins get char * arguments
+} BuildProgram;
+
+typedef struct {
+    Instruction* code;
+    size_t count, capacity;
+    char* strings;
+    size_t string_bytes, string_capacity;
+    uint32_t* offsets;
+    size_t num_strings, offsets_capacity;
+    uint32_t* slots; // open addressing over string ids + 1, keys are compared in place so tokens are never copied
+    size_t slot_capacity;
+} IrBuilder;
+
+char* ir_string(const BuildProgram* program, uint32_t id) {
+    return program->strings + program->offsets[id];
+}
+
+bool ir_string_equals(IrBuilder* builder, uint32_t id, const char* string, size_t length) {
+    const char* stored = builder->strings + builder->offsets[id];
+    return memcmp(stored, string, length) == 0 && stored[length] == '\0';
+}
+
+int ir_grow_slots(IrBuilder* builder) {
+    size_t new_capacity = builder->slot_capacity ? builder->slot_capacity * 2 : 512;
+    uint32_t* slots = calloc(new_capacity, sizeof(uint32_t));
+    if (!slots) return S_ERROR;
+    for (size_t id = 0; id < builder->num_strings; id++) {
+        const char* stored = builder->strings + builder->offsets[id];
+        size_t slot = (size_t)hash_bytes(S_HASH_SEED, stored, strlen(stored)) & (new_capacity - 1);
+        while (slots[slot]) slot = (slot + 1) & (new_capacity - 1);
+        slots[slot] = (uint32_t)id + 1;
     }
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        perror("Failed to open build file");
-        return;
+    free(builder->slots);
+    builder->slots = slots;
+    builder->slot_capacity = new_capacity;
+    return 0;
+}
+
+uint32_t ir_intern(IrBuilder* builder, const char* string, size_t length) {
+    if ((builder->num_strings + 1) * 2 > builder->slot_capacity && ir_grow_slots(builder) != 0) return UINT32_MAX;
+    size_t mask = builder->slot_capacity - 1;
+    size_t slot = (size_t)hash_bytes(S_HASH_SEED, string, length) & mask;
+    while (builder->slots[slot]) {
+        if (ir_string_equals(builder, builder->slots[slot] - 1, string, length)) return builder->slots[slot] - 1;
+        slot = (slot + 1) & mask;
     }
-    char program_arg[1024];
-    char line[2048];
-    memset(program_arg, 0, sizeof(program_arg));
-    memset(line, 0, sizeof(line));
 
-    char **argv = argv_;
+    if (builder->string_bytes + length + 1 > builder->string_capacity) {
+        size_t new_capacity = builder->string_capacity ? builder->string_capacity * 2 : 4096;
+        while (new_capacity < builder->string_bytes + length + 1) new_capacity *= 2;
+        char* temp = realloc(builder->strings, new_capacity);
+        if (!temp) return UINT32_MAX;
+        builder->strings = temp;
+        builder->string_capacity = new_capacity;
+    }
+    if (builder->num_strings == builder->offsets_capacity) {
+        size_t new_capacity = builder->offsets_capacity ? builder->offsets_capacity * 2 : 256;
+        uint32_t* temp = realloc(builder->offsets, new_capacity * sizeof(uint32_t));
+        if (!temp) return UINT32_MAX;
+        builder->offsets = temp;
+        builder->offsets_capacity = new_capacity;
+    }
+    memcpy(builder->strings + builder->string_bytes, string, length);
+    builder->strings[builder->string_bytes + length] = '\0';
+    builder->offsets[builder->num_strings] = (uint32_t)builder->string_bytes;
+    builder->string_bytes += length + 1;
+    builder->slots[slot] = (uint32_t)builder->num_strings + 1;
+    return (uint32_t)builder->num_strings++;
+}
 
-    if (argc == 1) {
-        argv = (char **)malloc(2 * sizeof(char*));
-        argv[0] = argv_[0];
-        argv[1] = strdup("default");
-        argc = 2;
+int ir_emit(IrBuilder* builder, uint32_t opcode, const char* string, size_t length, uint32_t b) {
+    if (builder->count == builder->capacity) {
+        size_t new_capacity = builder->capacity ? builder->capacity * 2 : 256;
+        Instruction* temp = realloc(builder->code, new_capacity * sizeof(Instruction));
+        if (!temp) return S_ERROR;
+        builder->code = temp;
+        builder->capacity = new_capacity;
     }
+    uint32_t id = ir_intern(builder, string, length);
+    if (id == UINT32_MAX) return S_ERROR;
+    builder->code[builder->count++] = (Instruction){opcode, id, b};
+    return 0;
+}
 
-    while (fgets(line, sizeof(line), file)) {
-        char* trimmed_line = trim(line);
-        if (strlen(trimmed_line) == 0 || trimmed_line[0] == '#') continue;
+// -- Tokenizer --
+// INFO: Works on the mmap'd build file, tokens point into the mapping, only strings with escapes are copied (to the arena)
+typedef enum { TOKEN_END, TOKEN_NEWLINE, TOKEN_WORD, TOKEN_STRING, TOKEN_LPAREN, TOKEN_RPAREN, TOKEN_COMMA, TOKEN_COLON, TOKEN_SEMICOLON, TOKEN_ERROR } TokenKind;
 
-        if (program_arg_mode) {
-            size_t len = strlen(trimmed_line) - 1;
-            if (len >= sizeof(program_arg)) {
-                fprintf(stderr, "Line length exceeds buffer size.\n");
-                continue;
-            }
+typedef struct {
+    TokenKind kind;
+    const char* start;
+    size_t length;
+    size_t line;
+} Token;
 
-            if (trimmed_line[len] == ':') {
-                strncpy(program_arg, trimmed_line, len);
-                program_arg[len] = '\0';
-                if (!CONTAINS_STRING(argv, argc, program_arg)) {
-                    continue;
-                }
+typedef struct {
+    const char* filename;
+    const char* cursor;
+    const char* end;
+    size_t line;
+    int depth; // inside (), newlines are whitespace there so calls can span lines
+    Arena* arena;
+} Lexer;
+
+Token lexer_error(Lexer* lexer, const char* message) {
+    fprintf(stderr, "Error: %s:%zu: %s\n", lexer->filename, lexer->line, message);
+    return (Token){TOKEN_ERROR, lexer->cursor, 0, lexer->line};
+}
+
+// "..." with \" \\ \n \t, any other escape stays as written
+Token lex_string(Lexer* lexer) {
+    size_t line = lexer->line;
+    const char* start = ++lexer->cursor;
+    bool escaped = false;
+    while (lexer->cursor < lexer->end && *lexer->cursor != '"') {
+        if (*lexer->cursor == '\n') return lexer_error(lexer, "unterminated string");
+        if (*lexer->cursor == '\\' && lexer->cursor + 1 < lexer->end) {
+            escaped = true;
+            lexer->cursor++;
+        }
+        lexer->cursor++;
+    }
+    if (lexer->cursor >= lexer->end) return lexer_error(lexer, "unterminated string");
+    const char* end = lexer->cursor++;
+    if (!escaped) return (Token){TOKEN_STRING, start, (size_t)(end - start), line};
+
+    char* copy = arena_alloc(lexer->arena, (size_t)(end - start) + 1);
+    if (!copy) return lexer_error(lexer, "out of memory");
+    size_t length = 0;
+    for (const char* c = start; c < end; c++) {
+        if (*c != '\\') {
+            copy[length++] = *c;
+            continue;
+        }
+        switch (*++c) {
+            case '"':  copy[length++] = '"'; break;
+            case '\\': copy[length++] = '\\'; break;
+            case 'n':  copy[length++] = '\n'; break;
+            case 't':  copy[length++] = '\t'; break;
+            default:   copy[length++] = '\\'; copy[length++] = *c; break;
+        }
+    }
+    copy[length] = '\0';
+    return (Token){TOKEN_STRING, copy, length, line};
+}
+
+// Unquoted argument, e.g. add_flag(-O2 -g): runs to the next top level ',' or ')' with quotes and () kept as written
+Token lex_bare_argument(Lexer* lexer) {
+    const char* start = lexer->cursor;
+    int nesting = 0;
+    while (lexer->cursor < lexer->end) {
+        char c = *lexer->cursor;
+        if (c == '\n' || (nesting == 0 && (c == ',' || c == ')'))) break;
+        if (c == '(') nesting++;
+        else if (c == ')') nesting--;
+        else if (c == '"') {
+            const char* quote = lexer->cursor++;
+            while (lexer->cursor < lexer->end && *lexer->cursor != '"' && *lexer->cursor != '\n') {
+                if (*lexer->cursor == '\\' && lexer->cursor + 1 < lexer->end) lexer->cursor++;
+                lexer->cursor++;
+            }
+            if (lexer->cursor >= lexer->end || *lexer->cursor != '"') {
+                lexer->cursor = quote;
+                return lexer_error(lexer, "unterminated string");
             }
         }
+        lexer->cursor++;
+    }
+    const char* end = lexer->cursor;
+    while (end > start && isspace((unsigned char)end[-1])) end--;
+    return (Token){TOKEN_WORD, start, (size_t)(end - start), lexer->line};
+}
+
+Token next_token(Lexer* lexer) {
+    while (lexer->cursor < lexer->end) {
+        char c = *lexer->cursor;
+        if (c == '\n') {
+            lexer->line++;
+            lexer->cursor++;
+            if (lexer->depth == 0) return (Token){TOKEN_NEWLINE, lexer->cursor - 1, 1, lexer->line - 1};
+        } else if (isspace((unsigned char)c)) {
+            lexer->cursor++;
+        } else if (c == '#') {
+            while (lexer->cursor < lexer->end && *lexer->cursor != '\n') lexer->cursor++;
+        } else {
+            break;
+        }
+    }
+    if (lexer->cursor >= lexer->end) return (Token){TOKEN_END, lexer->end, 0, lexer->line};
+
+    const char* start = lexer->cursor;
+    switch (*start) {
+        case '"': return lex_string(lexer);
+        case '(': lexer->depth++; lexer->cursor++; return (Token){TOKEN_LPAREN, start, 1, lexer->line};
+        case ')':
+            if (lexer->depth > 0) lexer->depth--;
+            lexer->cursor++;
+            return (Token){TOKEN_RPAREN, start, 1, lexer->line};
+        case ',': lexer->cursor++; return (Token){TOKEN_COMMA, start, 1, lexer->line};
+        case ':': lexer->cursor++; return (Token){TOKEN_COLON, start, 1, lexer->line};
+        case ';': lexer->cursor++; return (Token){TOKEN_SEMICOLON, start, 1, lexer->line};
+    }
+    if (lexer->depth > 0) return lex_bare_argument(lexer);
+    while (lexer->cursor < lexer->end && !isspace((unsigned char)*lexer->cursor) && !strchr("()\",:;", *lexer->cursor)) lexer->cursor++;
+    return (Token){TOKEN_WORD, start, (size_t)(lexer->cursor - start), lexer->line};
+}
+
+// Skips the rest of a statement the front end does not understand
+Token skip_statement(Lexer* lexer, Token token) {
+    lexer->depth = 0;
+    while (token.kind != TOKEN_NEWLINE && token.kind != TOKEN_END && token.kind != TOKEN_ERROR) token = next_token(lexer);
+    return token;
+}
+
+// name: dep1 dep2
+int ir_compile_target(IrBuilder* builder, Lexer* lexer, Token name) {
+    if (ir_emit(builder, OP_TARGET, name.start, name.length, 0) != 0) return S_ERROR;
+    for (Token dep = next_token(lexer); dep.kind != TOKEN_NEWLINE && dep.kind != TOKEN_END; dep = next_token(lexer)) {
+        if (dep.kind == TOKEN_COMMA) continue;
+        if (dep.kind != TOKEN_WORD) {
+            if (dep.kind != TOKEN_ERROR) lexer_error(lexer, "expected a dependency name");
+            return S_ERROR;
+        }
+        if (ir_emit(builder, OP_DEPEND, dep.start, dep.length, 0) != 0) return S_ERROR;
+    }
+    return 0;
+}
+
+// function(arg, "arg", ...) with an optional ';', the arguments are emitted once the call is complete
+int ir_compile_call(IrBuilder* builder, Lexer* lexer, Token name, Token** args, size_t* capacity) {
+    size_t argc = 0;
+    Token token = next_token(lexer);
+    while (token.kind != TOKEN_RPAREN) {
+        if (token.kind != TOKEN_STRING && token.kind != TOKEN_WORD) {
+            if (token.kind != TOKEN_ERROR) lexer_error(lexer, token.kind == TOKEN_END ? "missing ')'" : "expected an argument");
+            return S_ERROR;
+        }
+        if (argc == *capacity) {
+            size_t new_capacity = *capacity ? *capacity * 2 : 16;
+            Token* temp = realloc(*args, new_capacity * sizeof(Token));
+            if (!temp) return S_ERROR;
+            *args = temp;
+            *capacity = new_capacity;
+        }
+        (*args)[argc++] = token;
+        token = next_token(lexer);
+        if (token.kind == TOKEN_COMMA) token = next_token(lexer);
+        else if (token.kind != TOKEN_RPAREN) {
+            if (token.kind != TOKEN_ERROR) lexer_error(lexer, token.kind == TOKEN_END ? "missing ')'" : "expected ',' or ')'");
+            return S_ERROR;
+        }
+    }
+
+    token = next_token(lexer);
+    if (token.kind == TOKEN_SEMICOLON) token = next_token(lexer);
+    if (token.kind != TOKEN_NEWLINE && token.kind != TOKEN_END) {
+        if (token.kind != TOKEN_ERROR) lexer_error(lexer, "expected the end of the line");
+        return S_ERROR;
+    }
+
+    if (ir_emit(builder, OP_CALL, name.start, name.length, (uint32_t)argc) != 0) return S_ERROR;
+    for (size_t i = 0; i < argc; i++) {
+        if (ir_emit(builder, OP_ARG, (*args)[i].start, (*args)[i].length, 0) != 0) return S_ERROR;
+    }
+    return 0;
+}
+
+int compile_build_program(const char* filename, const char* source, uint64_t hash, size_t source_size, BuildProgram* program) {
+    IrBuilder builder = {0};
+    Arena arena = {0};
+    Lexer lexer = {filename, source, source + source_size, 1, 0, &arena};
+    Token* args = NULL;
+    size_t args_capacity = 0;
+    int result = 0;
 
-        size_t trimmed_line_len = strlen(trimmed_line);
-        if (trimmed_line_len > 0 && trimmed_line[trimmed_line_len - 1] == ':') {
-            strncpy(program_arg, trimmed_line, strlen(trimmed_line) - 2);
-            program_arg[strlen(trimmed_line) - 1] = '\0';
+    for (Token token = next_token(&lexer); token.kind != TOKEN_END && result == 0; token = next_token(&lexer)) {
+        if (token.kind == TOKEN_NEWLINE) continue;
+        if (token.kind != TOKEN_WORD) {
+            if (token.kind != TOKEN_ERROR) lexer_error(&lexer, "expected a target or function name");
+            result = S_ERROR;
+            break;
         }
+        Token next = next_token(&lexer);
+        if (next.kind == TOKEN_COLON) {
+            result = ir_compile_target(&builder, &lexer, token);
+        } else if (next.kind == TOKEN_LPAREN) {
+            result = ir_compile_call(&builder, &lexer, token, &args, &args_capacity);
+        } else if (next.kind == TOKEN_ERROR) {
+            result = S_ERROR;
+        } else {
+            fprintf(stderr, "Warning: %s:%zu: ignoring '%.*s', not a target or function call.\n", filename, token.line, (int)token.length, token.start);
+            if (skip_statement(&lexer, next).kind == TOKEN_ERROR) result = S_ERROR;
+        }
+    }
+
+    size_t size = sizeof(IrHeader) + builder.count * sizeof(Instruction) + builder.num_strings * sizeof(uint32_t) + builder.string_bytes;
+    char* memory = result == 0 ? malloc(size) : NULL;
+    if (memory) {
+        IrHeader header = {IR_MAGIC, hash, source_size, (uint32_t)builder.count, (uint32_t)builder.num_strings, (uint32_t)builder.string_bytes, 0};
+        char* out = memory;
+        memcpy(out, &header, sizeof(header));
+        out += sizeof(header);
+        if (builder.count) memcpy(out, builder.code, builder.count * sizeof(Instruction));
+        out += builder.count * sizeof(Instruction);
+        if (builder.num_strings) memcpy(out, builder.offsets, builder.num_strings * sizeof(uint32_t));
+        out += builder.num_strings * sizeof(uint32_t);
+        if (builder.string_bytes) memcpy(out, builder.strings, builder.string_bytes);
+
+        program->memory = memory;
+        program->size = size;
+        program->mapped = false;
+    }
+    free(builder.code);
+    free(builder.strings);
+    free(builder.offsets);
+    free(builder.slots);
+    free(args);
+    arena_free(&arena);
+    return memory ? 0 : S_ERROR;
+}
 
+// Points the program at its sections, rejects anything a crashed or foreign writer could have left behind
+bool open_build_program(BuildProgram* program, uint64_t hash, size_t source_size) {
+    if (program->size < sizeof(IrHeader)) return false;
+    const IrHeader* header = program->memory;
+    if (memcmp(header->magic, IR_MAGIC, 8) != 0 || header->source_hash != hash || header->source_size != source_size) return false;
+
+    size_t expected = sizeof(IrHeader) + (size_t)header->num_instructions * sizeof(Instruction) +
+                      (size_t)header->num_strings * sizeof(uint32_t) + header->string_bytes;
+    if (expected != program->size) return false;
+
+    program->code = (const Instruction*)(header + 1);
+    program->num_instructions = header->num_instructions;
+    program->offsets = (const uint32_t*)(program->code + header->num_instructions);
+    program->num_strings = header->num_strings;
+    program->strings = (char*)(program->offsets + header->num_strings);
+
+    if (header->string_bytes > 0 && program->strings[header->string_bytes - 1] != '\0') return false;
+    for (uint32_t i = 0; i < program->num_strings; i++) {
+        if (program->offsets[i] >= header->string_bytes) return false;
+    }
+    for (uint32_t i = 0; i < program->num_instructions; i++) {
+        if (program->code[i].a >= program->num_strings || program->code[i].opcode > OP_ARG) return false;
+        if (program->code[i].opcode == OP_CALL && program->code[i].b > program->num_instructions - i - 1) return false;
+    }
+    return true;
+}
+
+void free_build_program(BuildProgram* program) {
+    if (program->mapped) munmap(program->memory, program->size);
+    else free(program->memory);
+    memset(program, 0, sizeof(*program));
+}
+
+int load_build_program(const char* filename, BuildProgram* program) {
+    memset(program, 0, sizeof(*program));
+    int source_fd = open(filename, O_RDONLY);
+    struct stat source_stat;
+    if (source_fd < 0 || fstat(source_fd, &source_stat) != 0) {
+        perror("Failed to open build file");
+        if (source_fd >= 0) close(source_fd);
+        return S_ERROR;
+    }
+    size_t source_size = (size_t)source_stat.st_size;
+    const char* source = "";
+    if (source_size > 0) {
+        void* mapping = mmap(NULL, source_size, PROT_READ, MAP_PRIVATE, source_fd, 0);
+        if (mapping == MAP_FAILED) {
+            perror("Failed to map build file");
+            close(source_fd);
+            return S_ERROR;
+        }
+        source = mapping;
+    }
+    close(source_fd);
+    uint64_t hash = hash_bytes(S_HASH_SEED, source, source_size);
 
-        if (!program_arg_mode || CONTAINS_STRING(argv, argc, program_arg)) {
-            char* func_name_end = strchr(trimmed_line, '(');
-            if (!func_name_end) continue;
+    // .build.samba.ir next to build.samba
+    char ir_path[PATH_MAX];
+    const char* slash = strrchr(filename, '/');
+    if (slash) snprintf(ir_path, sizeof(ir_path), "%.*s/.%s.ir", (int)(slash - filename), filename, slash + 1);
+    else snprintf(ir_path, sizeof(ir_path), ".%s.ir", filename);
 
-            size_t func_name_len = func_name_end - trimmed_line;
-            char* func_name = malloc(func_name_len + 1);
-            if (!func_name) {
-                perror("Failed to allocate memory for function name");
-                continue;
+    int fd = open(ir_path, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* memory = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (memory != MAP_FAILED) {
+            program->memory = memory;
+            program->size = (size_t)st.st_size;
+            program->mapped = true;
+            if (open_build_program(program, hash, source_size)) {
+                close(fd);
+                if (source_size > 0) munmap((void*)source, source_size);
+                verbose_log("Using compiled build file %s\n", ir_path);
+                return 0;
             }
+            free_build_program(program);
+        }
+    }
+    if (fd >= 0) close(fd);
 
-            strncpy(func_name, trimmed_line, func_name_len);
-            func_name[func_name_len] = '\0';
+    int result = compile_build_program(filename, source, hash, source_size, program);
+    if (source_size > 0) munmap((void*)source, source_size);
+    if (result != 0 || !open_build_program(program, hash, source_size)) {
+        fprintf(stderr, "Error: Unable to compile '%s'.\n", filename);
+        free_build_program(program);
+        return S_ERROR;
+    }
 
-            char* args_str = func_name_end + 1;
-            char* args_end = strchr(args_str, ')');
-            if (!args_end) {
-                free(func_name);
-                continue;
+    // Best effort, a read-only checkout simply compiles every time
+    char temp_path[PATH_MAX + 32];
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", ir_path, (long)getpid());
+    FILE* file = fopen(temp_path, "wb");
+    if (file) {
+        bool written = fwrite(program->memory, 1, program->size, file) == program->size;
+        if (fclose(file) != 0 || !written || rename(temp_path, ir_path) != 0) unlink(temp_path);
+    }
+    return 0;
+}
+
+int execute_call(const BuildProgram* program, uint32_t call) {
+    const Instruction* instruction = &program->code[call];
+    char** argv = malloc((instruction->b + 1) * sizeof(char*));
+    if (!argv) return S_ERROR;
+    for (uint32_t i = 0; i < instruction->b; i++) argv[i] = ir_string(program, program->code[call + 1 + i].a);
+
+    StringArray args = {argv, instruction->b, instruction->b};
+    int result = execute_function(ir_string(program, instruction->a), &args);
+    free(argv);
+    return result;
+}
+
+// -- Targets --
+// INFO: Every "name:" section of build.samba is a target, "name: dep1 dep2" builds dep1 and dep2 first
+enum { TARGET_UNUSED, TARGET_WAITING, TARGET_RUNNING, TARGET_DONE, TARGET_FAILED, TARGET_SKIPPED };
+
+typedef struct {
+    uint32_t name; // string id, dependencies refer to targets by the same id
+    uint32_t* deps;
+    size_t num_deps;
+    uint32_t* calls; // OP_CALL instructions, in file order across all sections of the target
+    size_t num_calls;
+    int state;
+    int visit; // 0 = new, 1 = on the DFS stack, 2 = finished
+    pid_t pid;
+    double chain; // estimated seconds from starting this target to finishing everything that waits on it, -1 = unknown
+} BuildTarget;
+
+typedef struct {
+    BuildProgram program;
+    BuildTarget* items;
+    size_t count;
+    size_t capacity;
+} TargetGraph;
+
+const char* target_name(TargetGraph* graph, BuildTarget* target) {
+    return ir_string(&graph->program, target->name);
+}
+
+BuildTarget* find_target(TargetGraph* graph, const char* name) {
+    for (size_t i = 0; i < graph->count; i++) {
+        if (strcmp(target_name(graph, &graph->items[i]), name) == 0) return &graph->items[i];
+    }
+    return NULL;
+}
+
+BuildTarget* find_target_id(TargetGraph* graph, uint32_t name) {
+    for (size_t i = 0; i < graph->count; i++) {
+        if (graph->items[i].name == name) return &graph->items[i];
+    }
+    return NULL;
+}
+
+int push_id(uint32_t** items, size_t* count, uint32_t id) {
+    if (*count == 0 || (*count >= 4 && (*count & (*count - 1)) == 0)) { // capacity 4, 8, 16, ...
+        uint32_t* temp = realloc(*items, (*count ? *count * 2 : 4) * sizeof(uint32_t));
+        if (!temp) return S_ERROR;
+        *items = temp;
+    }
+    (*items)[(*count)++] = id;
+    return 0;
+}
+
+BuildTarget* add_target(TargetGraph* graph, uint32_t name) {
+    BuildTarget* target = find_target_id(graph, name);
+    if (target) return target; // a repeated section continues the target
+
+    if (graph->count == graph->capacity) {
+        size_t new_capacity = graph->capacity ? graph->capacity * 2 : 16;
+        BuildTarget* new_items = realloc(graph->items, new_capacity * sizeof(BuildTarget));
+        if (!new_items) return NULL;
+        graph->items = new_items;
+        graph->capacity = new_capacity;
+    }
+    target = &graph->items[graph->count++];
+    memset(target, 0, sizeof(*target));
+    target->name = name;
+    return target;
+}
+
+void free_target_graph(TargetGraph* graph) {
+    for (size_t i = 0; i < graph->count; i++) {
+        free(graph->items[i].deps);
+        free(graph->items[i].calls);
+    }
+    free(graph->items);
+    free_build_program(&graph->program);
+    memset(graph, 0, sizeof(*graph));
+}
+
+int load_target_graph(const char* filename, TargetGraph* graph) {
+    if (load_build_program(filename, &graph->program) != 0) return S_ERROR;
+
+    const BuildProgram* program = &graph->program;
+    BuildTarget* current = NULL;
+    for (uint32_t i = 0; i < program->num_instructions; i++) {
+        const Instruction* instruction = &program->code[i];
+        int result = 0;
+        if (instruction->opcode == OP_TARGET) {
+            current = add_target(graph, instruction->a);
+            if (!current) result = S_ERROR;
+        } else if (instruction->opcode == OP_DEPEND && current) {
+            result = push_id(&current->deps, &current->num_deps, instruction->a);
+        } else if (instruction->opcode == OP_CALL) {
+            if (current) result = push_id(&current->calls, &current->num_calls, i);
+            i += instruction->b;
+        }
+        if (result != 0) return S_ERROR;
+    }
+    return 0;
+}
+
+// Marks name and everything it depends on as wanted, fails on unknown targets and cycles
+int select_target(TargetGraph* graph, const char* name, const char* required_by) {
+    BuildTarget* target = find_target(graph, name);
+    if (!target) {
+        if (required_by) fprintf(stderr, "Error: Target '%s' needed by '%s' does not exist.\n", name, required_by);
+        else fprintf(stderr, "Error: Target '%s' does not exist.\n", name);
+        return S_ERROR;
+    }
+    if (target->visit == 2) return 0;
+    if (target->visit == 1) {
+        fprintf(stderr, "Error: Dependency cycle through target '%s'.\n", name);
+        return S_ERROR;
+    }
+
+    target->visit = 1;
+    for (size_t i = 0; i < target->num_deps; i++) {
+        if (select_target(graph, ir_string(&graph->program, target->deps[i]), name) != 0) return S_ERROR;
+    }
+    target->visit = 2;
+    target->state = TARGET_WAITING;
+    return 0;
+}
+
+// Runs in the forked child, settings made by one target never leak into another
+void run_target(TargetGraph* graph, BuildTarget* target) {
+    const char* name = target_name(graph, target);
+    verbose_log("Building target: %s\n", name);
+    trace_process_name(name);
+    long long trace_start = trace_now();
+    char* log_directory = build_directory; // the calls may change it, the scheduler reads the log from here
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    int result = 0;
+    for (size_t i = 0; i < target->num_calls && result == 0; i++) {
+        result = execute_call(&graph->program, target->calls[i]);
+    }
+
+    // Only a run that built something says how long the target takes
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    trace_event("target", name, NULL, trace_start, NULL, false);
+    if (result == 0 && build_steps_run > 0) {
+        char key[1024];
+        snprintf(key, sizeof(key), "target:%s", name);
+        char* current_directory = build_directory;
+        build_directory = log_directory;
+        record_duration(key, (double)(finished.tv_sec - started.tv_sec) + (double)(finished.tv_nsec - started.tv_nsec) / 1e9);
+        build_directory = current_directory;
+    }
+    print_cache_statistics();
+    exit(result == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+// Recorded duration of the target, or a guess from the size of the files its calls name
+double target_estimate(TargetGraph* graph, BuildTarget* target) {
+    char key[1024];
+    snprintf(key, sizeof(key), "target:%s", target_name(graph, target));
+
+    size_t num_files = 0;
+    for (size_t i = 0; i < target->num_calls; i++) num_files += graph->program.code[target->calls[i]].b;
+    char** files = malloc((num_files + 1) * sizeof(char*));
+    if (!files) return estimate_duration(key, NULL, 0);
+    num_files = 0;
+    for (size_t i = 0; i < target->num_calls; i++) {
+        uint32_t call = target->calls[i];
+        for (uint32_t j = 1; j <= graph->program.code[call].b; j++) {
+            files[num_files++] = ir_string(&graph->program, graph->program.code[call + j].a);
+        }
+    }
+    double seconds = estimate_duration(key, files, num_files);
+    free(files);
+    return seconds;
+}
+
+// Length of the longest chain of wanted targets that starts with target
+double target_chain(TargetGraph* graph, BuildTarget* target) {
+    if (target->chain >= 0) return target->chain;
+    double longest = 0;
+    for (size_t i = 0; i < graph->count; i++) {
+        BuildTarget* dependent = &graph->items[i];
+        if (dependent->state != TARGET_WAITING) continue;
+        for (size_t j = 0; j < dependent->num_deps; j++) {
+            if (dependent->deps[j] != target->name) continue;
+            double chain = target_chain(graph, dependent);
+            if (chain > longest) longest = chain;
+        }
+    }
+    target->chain = target_estimate(graph, target) + longest;
+    return target->chain;
+}
+
+bool target_ready(TargetGraph* graph, BuildTarget* target) {
+    for (size_t i = 0; i < target->num_deps; i++) {
+        if (find_target_id(graph, target->deps[i])->state != TARGET_DONE) return false;
+    }
+    return true;
+}
+
+// Builds the wanted targets in topological order, independent targets run at the same time in up to get_jobs() processes
+int run_target_graph(TargetGraph* graph) {
+    size_t running = 0;
+    size_t slots = (size_t)get_jobs();
+    bool failed = false;
+
+    // All targets draw their compiles and links from one budget, so N targets never run N * get_jobs() compilers
+    if (start_job_server((int)slots) != 0) {
+        fprintf(stderr, "Warning: Unable to share the job budget between targets, running them one at a time\n");
+        slots = 1;
+    }
+
+    for (size_t i = 0; i < graph->count; i++) graph->items[i].chain = -1;
+    for (size_t i = 0; i < graph->count; i++) {
+        if (graph->items[i].state == TARGET_WAITING) target_chain(graph, &graph->items[i]);
+    }
+
+    for (;;) {
+        // Start ready targets on the longest remaining chain first, stop starting once something failed
+        while (running < slots && !failed) {
+            BuildTarget* target = NULL;
+            for (size_t i = 0; i < graph->count; i++) {
+                BuildTarget* candidate = &graph->items[i];
+                if (candidate->state != TARGET_WAITING || !target_ready(graph, candidate)) continue;
+                if (!target || candidate->chain > target->chain) target = candidate;
             }
+            if (!target) break;
 
-            if (args_end < args_str) {
-                fprintf(stderr, "Arguments parsing error.\n");
-                free(func_name);
-                continue;
+            fflush(NULL);
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                failed = true;
+                break;
             }
-            *args_end = '\0';
-            StringArray* args = parse_arguments(args_str);
-            if (!args) {
-                free(func_name);
-                continue;
+            if (pid == 0) {
+                // Thread pools and parallel LTO links of the child size themselves to its share
+                set_jobs((int)(slots / (running + 1)) > 0 ? (int)(slots / (running + 1)) : 1);
+                run_target(graph, target);
             }
+            target->pid = pid;
+            target->state = TARGET_RUNNING;
+            running++;
+        }
+        if (running == 0) break;
 
-            if (!func_name || !args) {
-                fprintf(stderr, "Failed to parse function call.\n");
-                free(func_name);
-                free_string_array(args);
-                continue;
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            perror("waitpid");
+            return S_ERROR;
+        }
+        for (size_t i = 0; i < graph->count; i++) {
+            BuildTarget* target = &graph->items[i];
+            if (target->state != TARGET_RUNNING || target->pid != pid) continue;
+            running--;
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+                target->state = TARGET_DONE;
+            } else {
+                target->state = TARGET_FAILED;
+                failed = true;
+                fprintf(stderr, "Error: Target '%s' failed.\n", target_name(graph, target));
             }
-            execute_function(func_name, args);
+        }
+    }
 
-            free(func_name);
-            free_string_array(args);
-        } else continue;
+    for (size_t i = 0; i < graph->count; i++) {
+        if (graph->items[i].state == TARGET_WAITING) {
+            graph->items[i].state = TARGET_SKIPPED;
+            fprintf(stderr, "Skipped target '%s'.\n", target_name(graph, &graph->items[i]));
+        }
+    }
+    return failed ? S_ERROR : 0;
+}
+
+int parse_build_file(const char* filename, int argc, char **argv, bool program_arg_mode) {
+    if (!filename) {
+        fprintf(stderr, "Invalid filename.\n");
+        return S_ERROR;
     }
 
-    fclose(file);
+    TargetGraph graph = {0};
+    if (load_target_graph(filename, &graph) != 0) {
+        free_target_graph(&graph);
+        return S_ERROR;
+    }
+
+    int result = 0;
+    if (!program_arg_mode) {
+        // Every section in file order, in this process
+        for (size_t i = 0; i < graph.count && result == 0; i++) {
+            for (size_t j = 0; j < graph.items[i].num_calls && result == 0; j++) {
+                result = execute_call(&graph.program, graph.items[i].calls[j]);
+            }
+        }
+    } else {
+        if (argc == 1) result = select_target(&graph, "default", NULL);
+        for (int i = 1; i < argc && result == 0; i++) result = select_target(&graph, argv[i], NULL);
+        if (result == 0) result = run_target_graph(&graph);
+    }
+
+    free_target_graph(&graph);
+    return result;
 }
 
 int main(int argc, char* argv[]) {
@@ -426,14 +1131,33 @@ int main(int argc, char* argv[]) {
     } else if (argc == 2 && strcmp(argv[1], "--version_short") == 0) {
         printf("v3\n");
     } else {
-        clock_t start = clock();
-        parse_build_file("build.samba", argc, argv, true);
-        clock_t end = clock();
+        // --trace <file> may appear anywhere, everything else names targets
+        int targets = 1;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+                if (enable_trace(argv[++i]) != 0) return EXIT_FAILURE;
+            } else {
+                argv[targets++] = argv[i];
+            }
+        }
+        argc = targets;
+        if (register_builtins(samba_builtins) != 0) return EXIT_FAILURE;
 
-        double elapsed_time = (double)(end - start) / CLOCKS_PER_SEC;
-        if (elapsed_time < 0) elapsed_time = 0;
-        printf("Build completed in %.2f seconds.\n", elapsed_time);
+        // Wall time, clock() would only count samba's own CPU time while the compilers run
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        long long trace_start = trace_now();
+        int result = parse_build_file("build.samba", argc, argv, true);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        trace_event("build", "build", NULL, trace_start, NULL, false);
+        finish_trace();
 
-        return EXIT_SUCCESS;
+        double elapsed_time = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+        if (result != 0) {
+            fprintf(stderr, "Build failed.\n");
+            return EXIT_FAILURE;
+        }
+        printf("Build completed in %.2f seconds.\n", elapsed_time);
     }
+    return EXIT_SUCCESS;
 }
@@ -0,0 +1,80 @@
+// build.samba front end: gcc tests/test2.c -o tests/test2 -lpthread && ./tests/test2
+#define main samba_compiler_main
+#include "../samba_compiler.c"
+#undef main
+
+int failures = 0;
+
+void check(const char* name, bool working) {
+    if (working) printf("| %-36s | working ✔\n", name);
+    else printf("| %-36s | not working ✖\n", name);
+    if (!working) failures++;
+}
+
+bool parse(const char* source, BuildProgram* program) {
+    memset(program, 0, sizeof(*program));
+    if (compile_build_program("test.samba", source, 1, strlen(source), program) != 0) return false;
+    return open_build_program(program, 1, strlen(source));
+}
+
+// Arguments of the nth call in the program, NULL if there is no such call
+const Instruction* find_call(const BuildProgram* program, int nth) {
+    for (uint32_t i = 0; i < program->num_instructions; i++) {
+        if (program->code[i].opcode == OP_CALL && nth-- == 0) return &program->code[i];
+    }
+    return NULL;
+}
+
+bool call_is(const BuildProgram* program, int nth, const char* function, size_t argc, const char** argv) {
+    const Instruction* call = find_call(program, nth);
+    if (!call || strcmp(ir_string(program, call->a), function) != 0 || call->b != argc) return false;
+    for (size_t i = 0; i < argc; i++) {
+        if (strcmp(ir_string(program, call[1 + i].a), argv[i]) != 0) return false;
+    }
+    return true;
+}
+
+// Line of the first error token, 0 if the source lexes cleanly
+size_t error_line(const char* source) {
+    Arena arena = {0};
+    Lexer lexer = {"test.samba", source, source + strlen(source), 1, 0, &arena};
+    size_t line = 0;
+    for (Token token = next_token(&lexer); token.kind != TOKEN_END; token = next_token(&lexer)) {
+        if (token.kind == TOKEN_ERROR) {
+            line = token.line;
+            break;
+        }
+    }
+    arena_free(&arena);
+    return line;
+}
+
+int main() {
+    printf("build.samba front end:\n");
+    BuildProgram program;
+
+    const char* quoted[] = {"say \"hi\" \\ now"};
+    check("escaped quote in a string", parse("printfn(\"say \\\"hi\\\" \\\\ now\")\n", &program) && call_is(&program, 0, "printfn", 1, quoted));
+    free_build_program(&program);
+
+    const char* separators[] = {"a)b, c", "d"};
+    check("')' and ',' inside a string", parse("f(\"a)b, c\", \"d\")\n", &program) && call_is(&program, 0, "f", 2, separators));
+    free_build_program(&program);
+
+    const char* spanning[] = {"app", "a.c", "b.c"};
+    const char* after[] = {"done"};
+    check("call spanning several lines",
+          parse("default:\n    compile_target(\n        \"app\",  # the output\n        \"a.c\",\n        \"b.c\"\n    )\n    printfn(\"done\")\n", &program) &&
+          call_is(&program, 0, "compile_target", 3, spanning) && call_is(&program, 1, "printfn", 1, after));
+    free_build_program(&program);
+
+    check("unterminated string reports its line", error_line("a:\n    printfn(\"ok\")\n    printfn(\"oops)\n    printfn(\"b\")\n") == 3);
+    check("unterminated string is an error", !parse("a:\n    printfn(\"oops)\n", &program));
+    free_build_program(&program);
+
+    const char* bare[] = {"-O2 -g", "-DNAME=\"a, b\""};
+    check("bare multi-word argument", parse("add_flag(-O2 -g, -DNAME=\"a, b\")\n", &program) && call_is(&program, 0, "add_flag", 2, bare));
+    free_build_program(&program);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+// settings order: gcc tests/test3.c -o tests/test3 -lpthread -lcurl && ./tests/test3
+#include "../samba.h"
+
+int failures = 0;
+
+void check(const char* name, bool working) {
+    if (working) printf("| %-36s | working ✔\n", name);
+    else printf("| %-36s | not working ✖\n", name);
+    if (!working) failures++;
+}
+
+// The flags as the compiler would get them, tombstones skipped
+const char* joined_flags() {
+    static char text[1024];
+    text[0] = '\0';
+    for (size_t i = 0; i < num_flags; i++) {
+        if (!flags[i]) continue;
+        if (text[0]) strcat(text, " ");
+        strcat(text, flags[i]);
+    }
+    return text;
+}
+
+const char* joined_libraries() {
+    static char text[1024];
+    text[0] = '\0';
+    for (size_t i = 0; i < num_libraries; i++) {
+        if (!libraries[i].key) continue;
+        if (text[0]) strcat(text, " ");
+        strcat(text, libraries[i].key);
+    }
+    return text;
+}
+
+int main() {
+    printf("settings order:\n");
+
+    add_flag("-fPIC -fno-PIC -fPIC -O2 -O0 -O2");
+    check("repeated flag: the last one wins", strcmp(joined_flags(), "-fno-PIC -fPIC -O0 -O2") == 0);
+    reset_settings();
+
+    add_flag("-Iinclude -Ivendor -Iinclude -Lbuild -Llib -Lbuild");
+    check("repeated -I/-L keeps its first place", strcmp(joined_flags(), "-Iinclude -Ivendor -Lbuild -Llib") == 0);
+    reset_settings();
+
+    add_flag("-DMODE=1 -DMODE=2 -DMODE=1");
+    check("repeated define: the last one wins", strcmp(joined_flags(), "-DMODE=2 -DMODE=1") == 0);
+    reset_settings();
+
+    add_flag("-x c -include config.h -x c");
+    check("flag arguments are kept as given", strcmp(joined_flags(), "-x c -include config.h -x c") == 0);
+    reset_settings();
+
+    add_flag("-Wall -g -O2 -Wextra");
+    remove_flag("-g");
+    add_flag("-g");
+    check("remove keeps the order of the rest", strcmp(joined_flags(), "-Wall -O2 -Wextra -g") == 0);
+    reset_settings();
+
+    define_library("m");
+    define_library("z");
+    define_library("m");
+    check("library added again moves to the end", strcmp(joined_libraries(), "z m") == 0);
+    reset_settings();
+
+    char flag[32];
+    for (int i = 0; i < 200; i++) {
+        snprintf(flag, sizeof(flag), "-DN%d", i);
+        add_flag(flag);
+    }
+    for (int i = 0; i < 199; i++) {
+        snprintf(flag, sizeof(flag), "-DN%d", i);
+        remove_flag(flag);
+    }
+    add_flag("-DN199");
+    add_flag("-DN0");
+    check("many removals compact the list", strcmp(joined_flags(), "-DN199 -DN0") == 0 && num_flags < 200);
+    check("removed flags are gone", remove_flag("-DN5") == S_ERROR && remove_flag("-DN0") == 0);
+    reset_settings();
+
+    return failures == 0 ? 0 : 1;
+}